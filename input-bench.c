@@ -0,0 +1,708 @@
+/* GCW Zero input tester, benchmark and regression check for the input core
+ *
+ * Copyright (C) 2014 Nebuleon Fumika <nebuleon@gcw-zero.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* This program runs the input core alone, without SDL, on the host that
+ * builds the input tester. It applies seeded pseudo-random event streams to
+ * the built-in profile, compiled by profile.c as in the SDL 1.2 build of the
+ * tester, and reports the time taken per event, along with how many events
+ * were unmapped, applied or repeated and a checksum of the resulting state.
+ *
+ * The streams are:
+ * - one per event type, then one mixing all types;
+ * - recorded-mixed, the mixed stream written to a recording and read back,
+ *   which must give the same results as mixed;
+ * - devices-N, events from N joysticks, to see what more devices cost per
+ *   event once their tables and state no longer fit in the caches. The core
+ *   has tables for DEVICE_COUNT devices, so each DEVICE_COUNT of them get
+ *   their own copy of the tables and state, as separate testers would. Only
+ *   the axes, hats and buttons that the profile maps are used, so that every
+ *   event reaches the tables. A stream touches at most a table line and a
+ *   state line per event, so the largest touches up to 512 KiB;
+ * - with --profiles=FILE, profile-N, the mixed stream through the Nth
+ *   profile in FILE, which must parse without errors;
+ * - with --replay=FILE, the events recorded by the input tester's --record
+ *   option into FILE, mapped by the profile that the tester was using, which
+ *   is stored in the recording. The stream is named after FILE.
+ *
+ * With --expect=FILE, the counts and checksums are compared with those in
+ * FILE, which holds one line per stream:
+ *
+ *   NAME UNMAPPED APPLIED REPEATED CHECKSUM
+ *
+ * and the program exits with a non-zero status if any differ. With
+ * --max-ns=N, it also does so if any stream takes more than N nanoseconds
+ * per event. --print-expected writes the results in the format of FILE. */
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "input.h"
+#include "profile.h"
+
+#define STREAM_EVENTS     4096
+/* Each stream is applied this many times over in the timed part. */
+#define STREAM_ROUNDS      256
+
+#define STREAM_NAME_MAX     32
+#define EXPECTED_MAX        32
+
+/* The joystick inputs that a profile can map, and the most that the device
+ * streams can be spread over. */
+#define MAPPED_INPUT_MAX  (DEVICE_COUNT * JOY_INDEX_COUNT * 3)
+#define DEVICES_MAX       8192
+
+struct StreamResult {
+	char         Name[STREAM_NAME_MAX];
+	unsigned int Unmapped;
+	unsigned int Applied;
+	unsigned int Repeated;
+	uint32_t     Checksum;
+};
+
+/* DEVICE_COUNT of the devices in a device stream. */
+struct DeviceSet {
+	struct DispatchTables Tables;
+	struct InputState     State;
+};
+
+struct DeviceEvent {
+	unsigned int      Set;
+	struct InputEvent Event;
+};
+
+static const char* InputEventTypeNames[INPUT_EVENT_TYPE_COUNT] = {
+	"axis",
+	"hat",
+	"button-down",
+	"button-up",
+	"key-down",
+	"key-up",
+};
+
+/* SDL 1.2's names for its key symbols, as SDL_GetKeyName gives them, for the
+ * keys whose name is not their own character. Keys named by a character have
+ * that character's code, except for those below, which SDL 1.2 lacks.
+ * Profiles that name keys missing here fail to parse, in which case they need
+ * adding. */
+#define SDL1_MISSING_CHARACTERS "%{|}~"
+
+struct KeyName {
+	const char* Name;
+	int         Code;
+};
+
+static const struct KeyName SDL1KeyNames[] = {
+	{ "backspace", 8 },
+	{ "tab", 9 },
+	{ "clear", 12 },
+	{ "return", 13 },
+	{ "pause", 19 },
+	{ "escape", 27 },
+	{ "space", 32 },
+	{ "delete", 127 },
+	{ "up", 273 },
+	{ "down", 274 },
+	{ "right", 275 },
+	{ "left", 276 },
+	{ "insert", 277 },
+	{ "home", 278 },
+	{ "end", 279 },
+	{ "page up", 280 },
+	{ "page down", 281 },
+	{ "numlock", 300 },
+	{ "caps lock", 301 },
+	{ "scroll lock", 302 },
+	{ "right shift", 303 },
+	{ "left shift", 304 },
+	{ "right ctrl", 305 },
+	{ "left ctrl", 306 },
+	{ "right alt", 307 },
+	{ "left alt", 308 },
+	{ "right meta", 309 },
+	{ "left meta", 310 },
+	{ "left super", 311 },
+	{ "right super", 312 },
+	{ "alt gr", 313 },
+	{ "compose", 314 },
+	{ "help", 315 },
+	{ "print screen", 316 },
+	{ "sys req", 317 },
+	{ "break", 318 },
+	{ "menu", 319 },
+	{ "power", 320 },
+	{ "euro", 321 },
+	{ "undo", 322 },
+};
+
+/* The built-in profile, as compiled into Tables, and room for parsing. The
+ * element layout is of no use here, so the base profile is left empty. */
+struct Profile DefaultProfile;
+struct Profile Profiles[PROFILE_MAX];
+struct Profile BaseProfile;
+struct DispatchTables Tables;
+
+struct StreamResult Expected[EXPECTED_MAX];
+unsigned int ExpectedCount = 0;
+bool ExpectedSeen[EXPECTED_MAX];
+
+double MaxNanoseconds = 0;
+bool PrintExpected = false;
+bool Failed = false;
+
+// Resolves key names in profiles as the SDL 1.2 build of the input tester
+// does, so that the streams' key events are SDL 1.2 key symbols.
+static bool LookUpSDL1Key(const char* Name, int* Code)
+{
+	unsigned int i;
+
+	if (Name[0] != '\0' && Name[1] == '\0' && isgraph((unsigned char) Name[0])
+	 && strchr(SDL1_MISSING_CHARACTERS, Name[0]) == NULL)
+	{
+		*Code = tolower((unsigned char) Name[0]);
+		return true;
+	}
+	for (i = 0; i < sizeof(SDL1KeyNames) / sizeof(SDL1KeyNames[0]); i++)
+	{
+		if (strcasecmp(Name, SDL1KeyNames[i].Name) == 0)
+		{
+			*Code = SDL1KeyNames[i].Code;
+			return true;
+		}
+	}
+	return false;
+}
+
+static uint64_t ClockNanoseconds(void)
+{
+	struct timespec Time;
+	clock_gettime(CLOCK_MONOTONIC, &Time);
+	return (uint64_t) Time.tv_sec * 1000000000 + Time.tv_nsec;
+}
+
+static uint32_t BenchmarkRandom(uint32_t* Seed)
+{
+	*Seed = *Seed * 1103515245 + 12345;
+	return *Seed >> 8;
+}
+
+// Fills Events with pseudo-random events of the given type, or of all types
+// if Type is negative. The same seed always gives the same events, mapped
+// and unmapped alike.
+static void MakeSyntheticEvents(struct InputEvent* Events, unsigned int Count, int Type, uint32_t Seed)
+{
+	unsigned int i;
+
+	for (i = 0; i < Count; i++)
+	{
+		struct InputEvent* Event = &Events[i];
+		Event->Type = Type >= 0 ? (unsigned int) Type : BenchmarkRandom(&Seed) % INPUT_EVENT_TYPE_COUNT;
+		Event->Device = BenchmarkRandom(&Seed) % (DEVICE_COUNT + 1);
+		if (Event->Device == DEVICE_COUNT)
+			Event->Device = DEVICE_NONE;
+		switch (Event->Type)
+		{
+			case INPUT_AXIS:
+				Event->Index = BenchmarkRandom(&Seed) % 4;
+				Event->Value = (int16_t) BenchmarkRandom(&Seed);
+				break;
+			case INPUT_HAT:
+				Event->Index = BenchmarkRandom(&Seed) % 2;
+				Event->Value = BenchmarkRandom(&Seed) & (HAT_UP | HAT_RIGHT | HAT_DOWN | HAT_LEFT);
+				break;
+			case INPUT_BUTTON_DOWN:
+			case INPUT_BUTTON_UP:
+				Event->Index = BenchmarkRandom(&Seed) % 16;
+				Event->Value = 0;
+				break;
+			default:
+				Event->Device = DEVICE_NONE;
+				Event->Index = 0;
+				Event->Value = BenchmarkRandom(&Seed) % KEY_TABLE_SIZE;
+				break;
+		}
+	}
+}
+
+// Lists the joystick inputs that Tables maps, as events whose type and value
+// are to be filled in. Button events are listed as presses.
+static unsigned int ListMappedInputs(const struct DispatchTables* Tables, struct InputEvent* Inputs)
+{
+	unsigned int Count = 0, Device, i;
+
+	for (Device = 0; Device < DEVICE_COUNT; Device++)
+	{
+		for (i = 0; i < JOY_INDEX_COUNT; i++)
+		{
+			struct InputEvent Input = { .Device = Device, .Index = i, .Value = 0 };
+			if (Tables->AxisTargets[Device][i] != AXIS_NONE)
+			{
+				Input.Type = INPUT_AXIS;
+				Inputs[Count++] = Input;
+			}
+			if (Tables->DPadHats[Device][i])
+			{
+				Input.Type = INPUT_HAT;
+				Inputs[Count++] = Input;
+			}
+			if (Tables->ButtonElements[Device][i] != ELEMENT_NONE)
+			{
+				Input.Type = INPUT_BUTTON_DOWN;
+				Inputs[Count++] = Input;
+			}
+		}
+	}
+	return Count;
+}
+
+// Fills Events with pseudo-random events from the given inputs, spread over
+// SetCount device sets.
+static void MakeDeviceEvents(struct DeviceEvent* Events, unsigned int Count, const struct InputEvent* Inputs, unsigned int InputCount, unsigned int SetCount, uint32_t Seed)
+{
+	unsigned int i;
+
+	for (i = 0; i < Count; i++)
+	{
+		struct InputEvent* Event = &Events[i].Event;
+		Events[i].Set = BenchmarkRandom(&Seed) % SetCount;
+		*Event = Inputs[BenchmarkRandom(&Seed) % InputCount];
+		switch (Event->Type)
+		{
+			case INPUT_AXIS:
+				Event->Value = (int16_t) BenchmarkRandom(&Seed);
+				break;
+			case INPUT_HAT:
+				Event->Value = BenchmarkRandom(&Seed) & (HAT_UP | HAT_RIGHT | HAT_DOWN | HAT_LEFT);
+				break;
+			default:
+				Event->Type = (BenchmarkRandom(&Seed) >> 12) & 1 ? INPUT_BUTTON_DOWN : INPUT_BUTTON_UP;
+				break;
+		}
+	}
+}
+
+// Reads a recording made by the input tester, along with the name and tables
+// of the profile it was made with. Returns NULL on failure, after reporting
+// it.
+static struct InputEvent* ReadRecording(FILE* File, const char* Path, char ProfileName[INPUT_RECORDING_NAME_SIZE], struct DispatchTables* RecordedTables, unsigned int* Count)
+{
+	struct InputEvent* Events = NULL;
+	unsigned int Capacity = 0;
+	enum InputKeyCodes KeyCodes;
+
+	*Count = 0;
+	if (!ReadInputRecordingHeader(File, &KeyCodes, ProfileName, RecordedTables))
+	{
+		fprintf(stderr, "%s: Not an input recording in the current format, or a damaged one\n", Path);
+		return NULL;
+	}
+
+	while (true)
+	{
+		if (*Count == Capacity)
+		{
+			Capacity = Capacity == 0 ? STREAM_EVENTS : Capacity * 2;
+			struct InputEvent* Grown = realloc(Events, Capacity * sizeof(struct InputEvent));
+			if (Grown == NULL)
+			{
+				fprintf(stderr, "%s: Out of memory\n", Path);
+				free(Events);
+				return NULL;
+			}
+			Events = Grown;
+		}
+		if (!ReadInputEvent(File, &Events[*Count]))
+			break;
+		(*Count)++;
+	}
+
+	if (ferror(File) || *Count == 0)
+	{
+		fprintf(stderr, "%s: %s\n", Path, ferror(File) ? "Read error" : "No events recorded");
+		free(Events);
+		return NULL;
+	}
+	return Events;
+}
+
+// FNV-1a over the state, so that runs can be compared for identical results.
+static uint32_t InputStateChecksum(const struct InputState* State)
+{
+	const uint8_t* Bytes = (const uint8_t*) State;
+	uint32_t Result = 2166136261u;
+	unsigned int i;
+	for (i = 0; i < sizeof(*State); i++)
+		Result = (Result ^ Bytes[i]) * 16777619u;
+	return Result;
+}
+
+static const struct StreamResult* FindExpected(const char* Name)
+{
+	unsigned int i;
+	for (i = 0; i < ExpectedCount; i++)
+	{
+		if (strcmp(Expected[i].Name, Name) == 0)
+		{
+			ExpectedSeen[i] = true;
+			return &Expected[i];
+		}
+	}
+	return NULL;
+}
+
+static void ReportStream(const struct StreamResult* Result, double NsPerEvent)
+{
+	if (PrintExpected)
+		printf("%s %u %u %u %08x\n", Result->Name, Result->Unmapped, Result->Applied, Result->Repeated, Result->Checksum);
+	else
+		printf("  %-14s %7.2f ns/event %8.2f Mevents/s  unmapped %4u, applied %4u, repeated %4u  state %08x\n",
+			Result->Name, NsPerEvent, 1e3 / NsPerEvent,
+			Result->Unmapped, Result->Applied, Result->Repeated, Result->Checksum);
+
+	fflush(stdout);
+	const struct StreamResult* Expect = FindExpected(Result->Name);
+	if (Expect != NULL
+	 && (Expect->Unmapped != Result->Unmapped || Expect->Applied != Result->Applied
+	  || Expect->Repeated != Result->Repeated || Expect->Checksum != Result->Checksum))
+	{
+		fprintf(stderr, "%s: expected unmapped %u, applied %u, repeated %u, state %08x\n",
+			Result->Name, Expect->Unmapped, Expect->Applied, Expect->Repeated, Expect->Checksum);
+		Failed = true;
+	}
+	if (MaxNanoseconds > 0 && NsPerEvent > MaxNanoseconds)
+	{
+		fprintf(stderr, "%s: %.2f ns/event is over the limit of %.2f\n", Result->Name, NsPerEvent, MaxNanoseconds);
+		Failed = true;
+	}
+}
+
+static void RunStream(const char* Name, const struct DispatchTables* Tables, const struct InputEvent* Events, unsigned int Count)
+{
+	struct StreamResult Result;
+	struct InputState State;
+	unsigned int Results[INPUT_ALREADY_RELEASED + 1] = { 0 };
+	unsigned int i, Round;
+
+	// The first round counts the results. The others only apply events.
+	memset(&State, 0, sizeof(State));
+	for (i = 0; i < Count; i++)
+		Results[ApplyInputEvent(&State, Tables, &Events[i])]++;
+
+	memset(&Result, 0, sizeof(Result));
+	snprintf(Result.Name, sizeof(Result.Name), "%s", Name);
+	Result.Unmapped = Results[INPUT_UNMAPPED];
+	Result.Applied = Results[INPUT_APPLIED];
+	Result.Repeated = Results[INPUT_ALREADY_PRESSED] + Results[INPUT_ALREADY_RELEASED];
+	Result.Checksum = InputStateChecksum(&State);
+
+	uint64_t Start = ClockNanoseconds();
+	for (Round = 0; Round < STREAM_ROUNDS; Round++)
+		for (i = 0; i < Count; i++)
+			ApplyInputEvent(&State, Tables, &Events[i]);
+	uint64_t Time = ClockNanoseconds() - Start;
+	double NsPerEvent = (double) Time / ((uint64_t) STREAM_ROUNDS * Count);
+
+	ReportStream(&Result, NsPerEvent);
+}
+
+// Like RunStream, over SetCount device sets that all start out with Tables.
+// The checksum covers the state of every set.
+static void RunDeviceStream(const char* Name, struct DeviceSet* Sets, unsigned int SetCount, const struct DispatchTables* Tables, const struct DeviceEvent* Events, unsigned int Count)
+{
+	struct StreamResult Result;
+	unsigned int Results[INPUT_ALREADY_RELEASED + 1] = { 0 };
+	unsigned int i, Round;
+
+	for (i = 0; i < SetCount; i++)
+	{
+		Sets[i].Tables = *Tables;
+		memset(&Sets[i].State, 0, sizeof(Sets[i].State));
+	}
+
+	// The first round counts the results. The others only apply events.
+	for (i = 0; i < Count; i++)
+	{
+		struct DeviceSet* Set = &Sets[Events[i].Set];
+		Results[ApplyInputEvent(&Set->State, &Set->Tables, &Events[i].Event)]++;
+	}
+
+	memset(&Result, 0, sizeof(Result));
+	snprintf(Result.Name, sizeof(Result.Name), "%s", Name);
+	Result.Unmapped = Results[INPUT_UNMAPPED];
+	Result.Applied = Results[INPUT_APPLIED];
+	Result.Repeated = Results[INPUT_ALREADY_PRESSED] + Results[INPUT_ALREADY_RELEASED];
+	for (i = 0; i < SetCount; i++)
+		Result.Checksum = (Result.Checksum ^ InputStateChecksum(&Sets[i].State)) * 16777619u;
+
+	uint64_t Start = ClockNanoseconds();
+	for (Round = 0; Round < STREAM_ROUNDS; Round++)
+	{
+		for (i = 0; i < Count; i++)
+		{
+			struct DeviceSet* Set = &Sets[Events[i].Set];
+			ApplyInputEvent(&Set->State, &Set->Tables, &Events[i].Event);
+		}
+	}
+	uint64_t Time = ClockNanoseconds() - Start;
+	ReportStream(&Result, (double) Time / ((uint64_t) STREAM_ROUNDS * Count));
+}
+
+static void ReplayFile(const char* Path)
+{
+	static struct DispatchTables RecordedTables;
+	char ProfileName[INPUT_RECORDING_NAME_SIZE];
+	unsigned int Count;
+
+	FILE* File = fopen(Path, "rb");
+	if (File == NULL)
+	{
+		perror(Path);
+		Failed = true;
+		return;
+	}
+	struct InputEvent* Events = ReadRecording(File, Path, ProfileName, &RecordedTables, &Count);
+	fclose(File);
+	if (Events == NULL)
+	{
+		Failed = true;
+		return;
+	}
+
+	if (!PrintExpected)
+		printf("  %s was recorded with profile \"%s\"\n", Path, ProfileName);
+	RunStream(Path, &RecordedTables, Events, Count);
+	free(Events);
+}
+
+// Writes Events to a recording and reads them back through the same
+// functions as the input tester and ReplayFile.
+static void RunRecordedStream(const char* Name, const char* ProfileName, const struct InputEvent* Events, unsigned int Count)
+{
+	static struct DispatchTables RecordedTables;
+	char RecordedName[INPUT_RECORDING_NAME_SIZE];
+	unsigned int i;
+
+	FILE* File = tmpfile();
+	if (File == NULL)
+	{
+		perror("tmpfile");
+		Failed = true;
+		return;
+	}
+
+	bool Written = WriteInputRecordingHeader(File, INPUT_KEYS_SDL_1, ProfileName, &Tables);
+	for (i = 0; i < Count && Written; i++)
+		Written = WriteInputEvent(File, &Events[i]);
+	if (!Written || fflush(File) != 0)
+	{
+		perror("Writing the recording");
+		fclose(File);
+		Failed = true;
+		return;
+	}
+
+	unsigned int ReadCount;
+	rewind(File);
+	struct InputEvent* ReadEvents = ReadRecording(File, Name, RecordedName, &RecordedTables, &ReadCount);
+	fclose(File);
+	if (ReadEvents == NULL)
+	{
+		Failed = true;
+		return;
+	}
+	if (ReadCount != Count)
+	{
+		fprintf(stderr, "%s: %u events written, %u read back\n", Name, Count, ReadCount);
+		Failed = true;
+	}
+	if (strcmp(RecordedName, ProfileName) != 0 || memcmp(&RecordedTables, &Tables, sizeof(Tables)) != 0)
+	{
+		fprintf(stderr, "%s: The profile read back differs from the one written\n", Name);
+		Failed = true;
+	}
+	// The tables read back are used, so that any loss in them shows in the
+	// results too.
+	RunStream(Name, &RecordedTables, ReadEvents, ReadCount);
+	free(ReadEvents);
+}
+
+// Runs the mixed stream, Events, through each profile in the file at Path,
+// in streams named profile-N after their position in the file.
+static void RunProfileFile(const char* Path, const struct InputEvent* Events, unsigned int Count)
+{
+	static struct DispatchTables ProfileTables;
+	char Name[STREAM_NAME_MAX];
+	unsigned int ProfileCount, i;
+
+	FILE* File = fopen(Path, "r");
+	if (File == NULL)
+	{
+		perror(Path);
+		Failed = true;
+		return;
+	}
+	bool Parsed = ParseProfiles(File, Path, LookUpSDL1Key, &BaseProfile, Profiles, &ProfileCount);
+	fclose(File);
+	if (!Parsed)
+	{
+		Failed = true;
+		return;
+	}
+
+	if (!PrintExpected)
+		printf("  %s has %u profile(s)\n", Path, ProfileCount);
+	for (i = 0; i < ProfileCount; i++)
+	{
+		if (!PrintExpected)
+			printf("  profile-%u is \"%s\"\n", i + 1, Profiles[i].Name);
+		CompileProfile(&Profiles[i], &ProfileTables);
+		sprintf(Name, "profile-%u", i + 1);
+		RunStream(Name, &ProfileTables, Events, Count);
+	}
+}
+
+static bool LoadExpected(const char* Path)
+{
+	char Line[256];
+	unsigned int LineNumber = 0;
+
+	FILE* File = fopen(Path, "r");
+	if (File == NULL)
+	{
+		perror(Path);
+		return false;
+	}
+
+	while (fgets(Line, sizeof(Line), File) != NULL)
+	{
+		LineNumber++;
+		if (Line[0] == '#' || Line[strspn(Line, " \t\r\n")] == '\0')
+			continue;
+		if (ExpectedCount == EXPECTED_MAX)
+		{
+			fprintf(stderr, "%s:%u: Too many streams (at most %u)\n", Path, LineNumber, EXPECTED_MAX);
+			fclose(File);
+			return false;
+		}
+
+		struct StreamResult* Expect = &Expected[ExpectedCount];
+		if (sscanf(Line, "%31s %u %u %u %x", Expect->Name, &Expect->Unmapped, &Expect->Applied, &Expect->Repeated, &Expect->Checksum) != 5)
+		{
+			fprintf(stderr, "%s:%u: Invalid line\n", Path, LineNumber);
+			fclose(File);
+			return false;
+		}
+		ExpectedCount++;
+	}
+
+	fclose(File);
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	static struct InputEvent Events[STREAM_EVENTS];
+	static struct DeviceEvent DeviceEvents[STREAM_EVENTS];
+	static struct InputEvent MappedInputs[MAPPED_INPUT_MAX];
+	static const unsigned int DeviceCounts[] = { 2, 16, 128, 1024, DEVICES_MAX };
+	char Name[STREAM_NAME_MAX];
+	int i, Type;
+	unsigned int j, ProfileCount, MappedInputCount;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (strncmp(argv[i], "--expect=", 9) == 0)
+		{
+			if (!LoadExpected(argv[i] + 9))
+				return 2;
+		}
+		else if (strncmp(argv[i], "--max-ns=", 9) == 0)
+			MaxNanoseconds = atof(argv[i] + 9);
+		else if (strcmp(argv[i], "--print-expected") == 0)
+			PrintExpected = true;
+		else if (strncmp(argv[i], "--replay=", 9) == 0 || strncmp(argv[i], "--profiles=", 11) == 0)
+			;
+		else
+		{
+			fprintf(stderr, "Usage: %s [--expect=FILE] [--max-ns=N] [--print-expected] [--profiles=FILE]... [--replay=FILE]...\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (!ParseProfileText(BuiltInProfile, "built-in profile", LookUpSDL1Key, &BaseProfile, Profiles, &ProfileCount)
+	 || ProfileCount != 1)
+		return 2;
+	DefaultProfile = Profiles[0];
+	CompileProfile(&DefaultProfile, &Tables);
+
+	if (!PrintExpected)
+		printf("Benchmarking %u rounds of %u events per stream\n", STREAM_ROUNDS, STREAM_EVENTS);
+	for (Type = 0; Type < INPUT_EVENT_TYPE_COUNT; Type++)
+	{
+		MakeSyntheticEvents(Events, STREAM_EVENTS, Type, Type + 1);
+		RunStream(InputEventTypeNames[Type], &Tables, Events, STREAM_EVENTS);
+	}
+	MakeSyntheticEvents(Events, STREAM_EVENTS, -1, 0);
+	RunStream("mixed", &Tables, Events, STREAM_EVENTS);
+	RunRecordedStream("recorded-mixed", DefaultProfile.Name, Events, STREAM_EVENTS);
+
+	struct DeviceSet* Sets = malloc(DEVICES_MAX / DEVICE_COUNT * sizeof(struct DeviceSet));
+	if (Sets == NULL)
+	{
+		fprintf(stderr, "Out of memory\n");
+		return 2;
+	}
+	MappedInputCount = ListMappedInputs(&Tables, MappedInputs);
+	if (!PrintExpected)
+		printf("Device streams: %u mapped inputs, %u bytes of tables and state per %u devices\n",
+			MappedInputCount, (unsigned int) sizeof(struct DeviceSet), DEVICE_COUNT);
+	for (j = 0; j < sizeof(DeviceCounts) / sizeof(DeviceCounts[0]); j++)
+	{
+		unsigned int SetCount = DeviceCounts[j] / DEVICE_COUNT;
+		MakeDeviceEvents(DeviceEvents, STREAM_EVENTS, MappedInputs, MappedInputCount, SetCount, j + 1);
+		sprintf(Name, "devices-%u", DeviceCounts[j]);
+		RunDeviceStream(Name, Sets, SetCount, &Tables, DeviceEvents, STREAM_EVENTS);
+	}
+	free(Sets);
+
+	MakeSyntheticEvents(Events, STREAM_EVENTS, -1, 0);
+	for (i = 1; i < argc; i++)
+		if (strncmp(argv[i], "--profiles=", 11) == 0)
+			RunProfileFile(argv[i] + 11, Events, STREAM_EVENTS);
+
+	for (i = 1; i < argc; i++)
+		if (strncmp(argv[i], "--replay=", 9) == 0)
+			ReplayFile(argv[i] + 9);
+
+	for (j = 0; j < ExpectedCount; j++)
+	{
+		if (!ExpectedSeen[j])
+		{
+			fprintf(stderr, "%s: expected, but not run\n", Expected[j].Name);
+			Failed = true;
+		}
+	}
+
+	return Failed ? 1 : 0;
+}
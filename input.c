@@ -0,0 +1,189 @@
+/* GCW Zero input tester, input state core
+ *
+ * Copyright (C) 2014 Nebuleon Fumika <nebuleon@gcw-zero.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <string.h>
+
+#include "input.h"
+
+uint8_t InputEventElement(const struct DispatchTables* Tables, const struct InputEvent* Event)
+{
+	switch (Event->Type)
+	{
+		case INPUT_BUTTON_DOWN:
+		case INPUT_BUTTON_UP:
+			if (Event->Device >= DEVICE_COUNT)
+				return ELEMENT_NONE;
+			return Tables->ButtonElements[Event->Device][Event->Index];
+		case INPUT_KEY_DOWN:
+		case INPUT_KEY_UP:
+			if ((uint32_t) Event->Value >= KEY_TABLE_SIZE)
+				return ELEMENT_NONE;
+			return Tables->KeyElements[Event->Value];
+		default:
+			return ELEMENT_NONE;
+	}
+}
+
+enum InputResult ApplyInputEvent(struct InputState* State, const struct DispatchTables* Tables, const struct InputEvent* Event)
+{
+	enum InputResult Result = INPUT_APPLIED;
+	uint8_t Element;
+	bool Down;
+
+	switch (Event->Type)
+	{
+		case INPUT_AXIS:
+			if (Event->Device >= DEVICE_COUNT)
+				return INPUT_UNMAPPED;
+			{
+				uint8_t Axis = Tables->AxisTargets[Event->Device][Event->Index];
+				if (Axis == AXIS_NONE)
+					return INPUT_UNMAPPED;
+				State->AxisValues[Event->Device][Axis] = Event->Value;
+			}
+			return INPUT_APPLIED;
+
+		case INPUT_HAT:
+			if (Event->Device >= DEVICE_COUNT
+			 || !Tables->DPadHats[Event->Device][Event->Index])
+				return INPUT_UNMAPPED;
+			State->ElementPressed[ELEMENT_DPAD_UP   ] = !!(Event->Value & HAT_UP);
+			State->ElementPressed[ELEMENT_DPAD_DOWN ] = !!(Event->Value & HAT_DOWN);
+			State->ElementPressed[ELEMENT_DPAD_LEFT ] = !!(Event->Value & HAT_LEFT);
+			State->ElementPressed[ELEMENT_DPAD_RIGHT] = !!(Event->Value & HAT_RIGHT);
+			State->ElementEverPressed[ELEMENT_DPAD_UP   ] |= State->ElementPressed[ELEMENT_DPAD_UP];
+			State->ElementEverPressed[ELEMENT_DPAD_DOWN ] |= State->ElementPressed[ELEMENT_DPAD_DOWN];
+			State->ElementEverPressed[ELEMENT_DPAD_LEFT ] |= State->ElementPressed[ELEMENT_DPAD_LEFT];
+			State->ElementEverPressed[ELEMENT_DPAD_RIGHT] |= State->ElementPressed[ELEMENT_DPAD_RIGHT];
+			return INPUT_APPLIED;
+
+		case INPUT_BUTTON_DOWN:
+		case INPUT_BUTTON_UP:
+		case INPUT_KEY_DOWN:
+		case INPUT_KEY_UP:
+			Element = InputEventElement(Tables, Event);
+			if (Element == ELEMENT_NONE)
+				return INPUT_UNMAPPED;
+			Down = Event->Type == INPUT_BUTTON_DOWN || Event->Type == INPUT_KEY_DOWN;
+			if (State->ElementPressed[Element] && Down)
+				Result = INPUT_ALREADY_PRESSED;
+			else if (!State->ElementPressed[Element] && !Down)
+				Result = INPUT_ALREADY_RELEASED;
+			State->ElementPressed[Element] = Down;
+			// Releasing a key marks its element as having been pressed, even
+			// if the key was pressed before the program started.
+			if (Event->Type == INPUT_BUTTON_DOWN || Event->Type == INPUT_BUTTON_UP)
+				State->ElementEverPressed[Element] |= Down;
+			else
+				State->ElementEverPressed[Element] = true;
+			return Result;
+
+		default:
+			return INPUT_UNMAPPED;
+	}
+}
+
+bool WriteInputRecordingHeader(FILE* File, enum InputKeyCodes KeyCodes, const char* ProfileName, const struct DispatchTables* Tables)
+{
+	uint8_t Header[8] = { 'I', 'N', 'E', 'V', INPUT_RECORDING_VERSION, KeyCodes, 0, 0 };
+	uint8_t DPadHats[DEVICE_COUNT][JOY_INDEX_COUNT];
+	char Name[INPUT_RECORDING_NAME_SIZE] = { 0 };
+	unsigned int Device, i;
+
+	strncpy(Name, ProfileName, sizeof(Name) - 1);
+	for (Device = 0; Device < DEVICE_COUNT; Device++)
+		for (i = 0; i < JOY_INDEX_COUNT; i++)
+			DPadHats[Device][i] = Tables->DPadHats[Device][i];
+
+	return fwrite(Header, sizeof(Header), 1, File) == 1
+	    && fwrite(Name, sizeof(Name), 1, File) == 1
+	    && fwrite(Tables->KeyElements, sizeof(Tables->KeyElements), 1, File) == 1
+	    && fwrite(Tables->ButtonElements, sizeof(Tables->ButtonElements), 1, File) == 1
+	    && fwrite(Tables->AxisTargets, sizeof(Tables->AxisTargets), 1, File) == 1
+	    && fwrite(DPadHats, sizeof(DPadHats), 1, File) == 1;
+}
+
+static bool ValidElements(const uint8_t* Elements, size_t Count)
+{
+	size_t i;
+	for (i = 0; i < Count; i++)
+		if (Elements[i] >= ELEMENT_COUNT && Elements[i] != ELEMENT_NONE)
+			return false;
+	return true;
+}
+
+bool ReadInputRecordingHeader(FILE* File, enum InputKeyCodes* KeyCodes, char ProfileName[INPUT_RECORDING_NAME_SIZE], struct DispatchTables* Tables)
+{
+	uint8_t Header[8];
+	uint8_t DPadHats[DEVICE_COUNT][JOY_INDEX_COUNT];
+	unsigned int Device, i;
+
+	if (fread(Header, sizeof(Header), 1, File) != 1
+	 || Header[0] != 'I' || Header[1] != 'N' || Header[2] != 'E' || Header[3] != 'V'
+	 || Header[4] != INPUT_RECORDING_VERSION
+	 || (Header[5] != INPUT_KEYS_SDL_1 && Header[5] != INPUT_KEYS_SDL_2)
+	 || fread(ProfileName, INPUT_RECORDING_NAME_SIZE, 1, File) != 1
+	 || fread(Tables->KeyElements, sizeof(Tables->KeyElements), 1, File) != 1
+	 || fread(Tables->ButtonElements, sizeof(Tables->ButtonElements), 1, File) != 1
+	 || fread(Tables->AxisTargets, sizeof(Tables->AxisTargets), 1, File) != 1
+	 || fread(DPadHats, sizeof(DPadHats), 1, File) != 1)
+		return false;
+
+	// ApplyInputEvent indexes the state by these without a bounds check.
+	if (!ValidElements(Tables->KeyElements, sizeof(Tables->KeyElements))
+	 || !ValidElements(&Tables->ButtonElements[0][0], sizeof(Tables->ButtonElements)))
+		return false;
+	for (Device = 0; Device < DEVICE_COUNT; Device++)
+	{
+		for (i = 0; i < JOY_INDEX_COUNT; i++)
+		{
+			if ((Tables->AxisTargets[Device][i] >= AXIS_COUNT && Tables->AxisTargets[Device][i] != AXIS_NONE)
+			 || DPadHats[Device][i] > 1)
+				return false;
+			Tables->DPadHats[Device][i] = DPadHats[Device][i];
+		}
+	}
+
+	ProfileName[INPUT_RECORDING_NAME_SIZE - 1] = '\0';
+	*KeyCodes = Header[5];
+	return true;
+}
+
+bool WriteInputEvent(FILE* File, const struct InputEvent* Event)
+{
+	uint32_t Value = Event->Value;
+	uint8_t Record[8] = {
+		Event->Type, Event->Device, Event->Index, 0,
+		Value, Value >> 8, Value >> 16, Value >> 24
+	};
+	return fwrite(Record, sizeof(Record), 1, File) == 1;
+}
+
+bool ReadInputEvent(FILE* File, struct InputEvent* Event)
+{
+	uint8_t Record[8];
+	if (fread(Record, sizeof(Record), 1, File) != 1)
+		return false;
+	Event->Type = Record[0];
+	Event->Device = Record[1];
+	Event->Index = Record[2];
+	Event->Value = (int32_t) ((uint32_t) Record[4] | (uint32_t) Record[5] << 8
+	                        | (uint32_t) Record[6] << 16 | (uint32_t) Record[7] << 24);
+	return true;
+}
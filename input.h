@@ -0,0 +1,155 @@
+/* GCW Zero input tester, input state core
+ *
+ * Copyright (C) 2014 Nebuleon Fumika <nebuleon@gcw-zero.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* This part of the input tester turns input events into the state shown on
+ * the screen. It does not depend on SDL, so it is built once and shared by
+ * both versions of the program. */
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Binary elements (pressed or not) that are shown on the display. */
+enum Element {
+	ELEMENT_DPAD_UP,
+	ELEMENT_DPAD_DOWN,
+	ELEMENT_DPAD_LEFT,
+	ELEMENT_DPAD_RIGHT,
+	ELEMENT_Y,
+	ELEMENT_B,
+	ELEMENT_X,
+	ELEMENT_A,
+	ELEMENT_SELECT,
+	ELEMENT_START,
+	ELEMENT_L,
+	ELEMENT_R,
+	ELEMENT_POWER,
+	ELEMENT_HOLD,
+};
+#define ELEMENT_COUNT   14
+#define ELEMENT_NONE    0xFF
+
+/* Joysticks that have a role in the display. */
+enum Device {
+	DEVICE_BUILT_IN, /* the analog nub, d-pad and buttons */
+	DEVICE_G_SENSOR,
+};
+#define DEVICE_COUNT    2
+#define DEVICE_NONE     0xFF
+
+enum Axis {
+	AXIS_X,
+	AXIS_Y,
+};
+#define AXIS_COUNT      2
+#define AXIS_NONE       0xFF
+
+/* Hat directions, with the same values as SDL_HAT_*. */
+#define HAT_UP          0x01
+#define HAT_RIGHT       0x02
+#define HAT_DOWN        0x04
+#define HAT_LEFT        0x08
+
+/* Large enough for key symbols in SDL 1.2 (SDLK_LAST) and scancodes in
+ * SDL 2.0 (SDL_NUM_SCANCODES). */
+#define KEY_TABLE_SIZE  512
+
+/* Joystick axes, buttons and hats are numbered by a Uint8 in events, so
+ * tables indexed by them can cover every possible number and need no bounds
+ * check. */
+#define JOY_INDEX_COUNT 256
+
+/* A profile compiled so that each event is resolved with a single load. */
+struct DispatchTables {
+	uint8_t KeyElements[KEY_TABLE_SIZE];
+	uint8_t ButtonElements[DEVICE_COUNT][JOY_INDEX_COUNT];
+	uint8_t AxisTargets[DEVICE_COUNT][JOY_INDEX_COUNT];
+	bool    DPadHats[DEVICE_COUNT][JOY_INDEX_COUNT];
+};
+
+enum InputEventType {
+	INPUT_AXIS,
+	INPUT_HAT,
+	INPUT_BUTTON_DOWN,
+	INPUT_BUTTON_UP,
+	INPUT_KEY_DOWN,
+	INPUT_KEY_UP,
+};
+#define INPUT_EVENT_TYPE_COUNT 6
+
+struct InputEvent {
+	uint8_t Type;
+	uint8_t Device; /* joystick events only; DEVICE_NONE if not in use */
+	uint8_t Index; /* the axis, hat or button */
+	int32_t Value; /* the axis's value, the hat's HAT_* bits, or the key */
+};
+
+struct InputState {
+	bool    ElementPressed[ELEMENT_COUNT];
+	bool    ElementEverPressed[ELEMENT_COUNT];
+	int16_t AxisValues[DEVICE_COUNT][AXIS_COUNT];
+};
+
+enum InputResult {
+	INPUT_UNMAPPED, /* the event has no effect on the state */
+	INPUT_APPLIED,
+	INPUT_ALREADY_PRESSED, /* applied, but the element was already pressed */
+	INPUT_ALREADY_RELEASED, /* applied, but the element was already released */
+};
+
+/* Updates State according to Event, as mapped by Tables. */
+extern enum InputResult ApplyInputEvent(struct InputState* State, const struct DispatchTables* Tables, const struct InputEvent* Event);
+
+/* Returns the element that Event is mapped to by Tables, or ELEMENT_NONE.
+ * Axis and hat events always map to ELEMENT_NONE. */
+extern uint8_t InputEventElement(const struct DispatchTables* Tables, const struct InputEvent* Event);
+
+/* Recordings are files of InputEvents, so that a real session can be replayed
+ * through the core later on, with the profile it was recorded with. They
+ * start with an 8-byte header: "INEV", the format version, then the kind of
+ * key codes used by key events. The profile's name follows, NUL-padded to
+ * INPUT_RECORDING_NAME_SIZE bytes, then its DispatchTables, one byte per
+ * entry in the order of the structure. Each event follows in 8 bytes: Type,
+ * Device and Index, a zero byte, then Value as a little-endian 32-bit
+ * integer. */
+#define INPUT_RECORDING_VERSION   2
+#define INPUT_RECORDING_NAME_SIZE 64
+
+enum InputKeyCodes {
+	INPUT_KEYS_SDL_1 = 1, /* SDL 1.2 key symbols */
+	INPUT_KEYS_SDL_2 = 2, /* SDL 2.0 scancodes */
+};
+
+/* The name is cut short if it does not fit. */
+extern bool WriteInputRecordingHeader(FILE* File, enum InputKeyCodes KeyCodes, const char* ProfileName, const struct DispatchTables* Tables);
+
+/* Returns false if the file is not a recording in a known version, or if its
+ * tables map anything to elements or axes that do not exist. */
+extern bool ReadInputRecordingHeader(FILE* File, enum InputKeyCodes* KeyCodes, char ProfileName[INPUT_RECORDING_NAME_SIZE], struct DispatchTables* Tables);
+
+extern bool WriteInputEvent(FILE* File, const struct InputEvent* Event);
+
+/* Returns false at the end of the file or on error, which ferror tells
+ * apart. */
+extern bool ReadInputEvent(FILE* File, struct InputEvent* Event);
+
+#endif /* !INPUT_H */
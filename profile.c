@@ -0,0 +1,437 @@
+/* GCW Zero input tester, device profiles
+ *
+ * Copyright (C) 2014 Nebuleon Fumika <nebuleon@gcw-zero.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* Profile files are made of lines of whitespace-separated words. Words may be
+ * enclosed in double quotes to contain whitespace, and '#' starts a comment
+ * that extends to the end of the line. The words recognised are:
+ *
+ * profile NAME                   Starts a new profile.
+ * joystick DEVICE PATTERN        Uses the joystick whose name matches PATTERN
+ *                                (with fnmatch(3) wildcards) as DEVICE.
+ * axes DEVICE X Y                DEVICE's axes that move its dot.
+ * hat DEVICE INDEX               DEVICE's hat that moves the d-pad.
+ * button DEVICE INDEX ELEMENT    DEVICE's button INDEX lights up ELEMENT.
+ * key KEY ELEMENT                KEY lights up ELEMENT. KEY is a key name as
+ *                                given by SDL, such as "left ctrl" or "1", or
+ *                                a raw key code prefixed with "code:", such as
+ *                                code:49.
+ * rect ELEMENT X Y W H           Where ELEMENT is drawn.
+ * color ELEMENT R G B R G B      ELEMENT's colours when it is pressed, then
+ *                                when it has been pressed before.
+ *
+ * DEVICE is one of "builtin" and "gsensor". ELEMENT is one of the identifiers
+ * in ElementIds below. */
+
+#include <ctype.h>
+#include <fnmatch.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "profile.h"
+
+#define LINE_MAX_LENGTH  512
+#define WORD_MAX          10
+
+static const char* ElementIds[ELEMENT_COUNT] = {
+	"dpad_up",
+	"dpad_down",
+	"dpad_left",
+	"dpad_right",
+	"y",
+	"b",
+	"x",
+	"a",
+	"select",
+	"start",
+	"l",
+	"r",
+	"power",
+	"hold",
+};
+
+static const char* DeviceIds[DEVICE_COUNT] = {
+	"builtin",
+	"gsensor",
+};
+
+/* The key names below are those of both SDL 1.2 and SDL 2.0, which only
+ * differ in case. */
+const char BuiltInProfile[] =
+	"profile \"GCW Zero (built-in)\"\n"
+	"	joystick builtin \"linkdev device (Analog 2-axis 8-button 2-hat)\"\n"
+	"	joystick gsensor \"mxc6225\"\n"
+	"\n"
+	"	axes builtin 0 1\n"
+	"	axes gsensor 0 1\n"
+	"	hat builtin 0\n"
+	"\n"
+	"	button builtin 0 b\n"
+	"	button builtin 1 a\n"
+	"	button builtin 2 y\n"
+	"	button builtin 3 x\n"
+	"	button builtin 4 select\n"
+	"	button builtin 5 start\n"
+	"	button builtin 6 l\n"
+	"	button builtin 7 r\n"
+	"\n"
+	"	# Keys that are not covered by the joystick, or that are used when the\n"
+	"	# GCW Zero's buttons are not being mapped to it.\n"
+	"	key left          dpad_left\n"
+	"	key right         dpad_right\n"
+	"	key up            dpad_up\n"
+	"	key down          dpad_down\n"
+	"	key \"left ctrl\"   a\n"
+	"	key \"left alt\"    b\n"
+	"	key \"left shift\"  x\n"
+	"	key space         y\n"
+	"	key tab           l\n"
+	"	key backspace     r\n"
+	"	key escape        select\n"
+	"	key return        start\n"
+	"	key home          power\n"
+	"	key pause         hold\n";
+
+/* Splits a line into words in place. Returns the number of words, or -1 if a
+ * quote is left unterminated. */
+static int SplitWords(char* Line, char** Words)
+{
+	int Count = 0;
+	char* Read = Line;
+
+	while (true)
+	{
+		while (isspace((unsigned char) *Read))
+			Read++;
+		if (*Read == '\0' || *Read == '#')
+			return Count;
+		if (Count == WORD_MAX)
+			return Count;
+
+		if (*Read == '"')
+		{
+			Words[Count++] = ++Read;
+			while (*Read != '"')
+			{
+				if (*Read == '\0')
+					return -1;
+				Read++;
+			}
+		}
+		else
+		{
+			Words[Count++] = Read;
+			while (*Read != '\0' && *Read != '#' && !isspace((unsigned char) *Read))
+				Read++;
+			if (*Read == '#')
+			{
+				*Read = '\0';
+				return Count;
+			}
+		}
+
+		if (*Read == '\0')
+			return Count;
+		*Read++ = '\0';
+	}
+}
+
+static bool ParseNumber(const char* Word, int Min, int Max, int* Result)
+{
+	char* End;
+	long Value = strtol(Word, &End, 10);
+	if (*Word == '\0' || *End != '\0' || Value < Min || Value > Max)
+		return false;
+	*Result = Value;
+	return true;
+}
+
+static bool ParseId(const char* Word, const char** Ids, unsigned int Count, unsigned int* Result)
+{
+	unsigned int i;
+	for (i = 0; i < Count; i++)
+	{
+		if (strcasecmp(Word, Ids[i]) == 0)
+		{
+			*Result = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+#define KEY_CODE_PREFIX "code:"
+
+// Key names come first, and raw codes need a prefix, as some names (those of
+// the digit keys) are numbers themselves. CompileProfile indexes KeyElements
+// by the result without a bounds check.
+static bool ParseKey(const char* Word, KeyLookup LookUpKey, int* Result)
+{
+	if (strncasecmp(Word, KEY_CODE_PREFIX, strlen(KEY_CODE_PREFIX)) == 0)
+		return ParseNumber(Word + strlen(KEY_CODE_PREFIX), 0, KEY_TABLE_SIZE - 1, Result);
+	return LookUpKey(Word, Result) && *Result >= 0 && *Result < KEY_TABLE_SIZE;
+}
+
+static void StartProfile(struct Profile* Profile, const struct Profile* Base, const char* Name)
+{
+	unsigned int i;
+
+	memset(Profile, 0, sizeof(*Profile));
+	strncpy(Profile->Name, Name, PROFILE_NAME_MAX - 1);
+	for (i = 0; i < DEVICE_COUNT; i++)
+	{
+		Profile->Devices[i].Axes[AXIS_X] = -1;
+		Profile->Devices[i].Axes[AXIS_Y] = -1;
+		Profile->Devices[i].DPadHat = -1;
+	}
+	memcpy(Profile->Elements, Base->Elements, sizeof(Profile->Elements));
+}
+
+static bool AddMapping(struct Mapping* Mappings, unsigned int* Count, int Code, unsigned int Element)
+{
+	if (*Count == PROFILE_MAPPING_MAX)
+		return false;
+	Mappings[*Count].Code = Code;
+	Mappings[*Count].Element = Element;
+	(*Count)++;
+	return true;
+}
+
+/* The state of a parse, from one line to the next. */
+struct Parser {
+	const char*           Path;
+	unsigned int          LineNumber;
+	KeyLookup             LookUpKey;
+	const struct Profile* Base;
+	struct Profile*       Profiles;
+	unsigned int*         Count;
+	struct Profile*       Profile; /* the one being read, if any */
+};
+
+// Parses one line. Returns false if it is invalid, after reporting it.
+static bool ParseLine(struct Parser* Parser, char* Line)
+{
+	const char* Path = Parser->Path;
+	unsigned int LineNumber = Parser->LineNumber;
+	struct Profile* Profile = Parser->Profile;
+	char* Words[WORD_MAX];
+
+	int WordCount = SplitWords(Line, Words);
+	if (WordCount == 0)
+		return true;
+	if (WordCount < 0)
+	{
+		printf("%s:%u: Unterminated quote\n", Path, LineNumber);
+		return false;
+	}
+
+	const char* Directive = Words[0];
+	unsigned int Device, Element;
+	int Values[6];
+	int i;
+
+	if (strcmp(Directive, "profile") == 0)
+	{
+		if (WordCount != 2)
+			goto usage;
+		if (*Parser->Count == PROFILE_MAX)
+		{
+			printf("%s:%u: Too many profiles (at most %u)\n", Path, LineNumber, PROFILE_MAX);
+			return false;
+		}
+		Parser->Profile = &Parser->Profiles[(*Parser->Count)++];
+		StartProfile(Parser->Profile, Parser->Base, Words[1]);
+		return true;
+	}
+
+	if (Profile == NULL)
+	{
+		printf("%s:%u: \"%s\" outside of a profile\n", Path, LineNumber, Directive);
+		return false;
+	}
+
+	if (strcmp(Directive, "joystick") == 0)
+	{
+		if (WordCount != 3 || !ParseId(Words[1], DeviceIds, DEVICE_COUNT, &Device))
+			goto usage;
+		strncpy(Profile->Devices[Device].NamePattern, Words[2], PROFILE_PATTERN_MAX - 1);
+	}
+	else if (strcmp(Directive, "axes") == 0)
+	{
+		if (WordCount != 4 || !ParseId(Words[1], DeviceIds, DEVICE_COUNT, &Device)
+		 || !ParseNumber(Words[2], 0, JOY_INDEX_COUNT - 1, &Profile->Devices[Device].Axes[AXIS_X])
+		 || !ParseNumber(Words[3], 0, JOY_INDEX_COUNT - 1, &Profile->Devices[Device].Axes[AXIS_Y]))
+			goto usage;
+	}
+	else if (strcmp(Directive, "hat") == 0)
+	{
+		if (WordCount != 3 || !ParseId(Words[1], DeviceIds, DEVICE_COUNT, &Device)
+		 || !ParseNumber(Words[2], 0, JOY_INDEX_COUNT - 1, &Profile->Devices[Device].DPadHat))
+			goto usage;
+	}
+	else if (strcmp(Directive, "button") == 0)
+	{
+		if (WordCount != 4 || !ParseId(Words[1], DeviceIds, DEVICE_COUNT, &Device)
+		 || !ParseNumber(Words[2], 0, JOY_INDEX_COUNT - 1, &Values[0])
+		 || !ParseId(Words[3], ElementIds, ELEMENT_COUNT, &Element))
+			goto usage;
+		if (!AddMapping(Profile->Devices[Device].Buttons, &Profile->Devices[Device].ButtonCount, Values[0], Element))
+			goto too_many;
+	}
+	else if (strcmp(Directive, "key") == 0)
+	{
+		if (WordCount != 3 || !ParseId(Words[2], ElementIds, ELEMENT_COUNT, &Element))
+			goto usage;
+		if (!ParseKey(Words[1], Parser->LookUpKey, &Values[0]))
+		{
+			printf("%s:%u: Unknown key \"%s\"\n", Path, LineNumber, Words[1]);
+			return false;
+		}
+		if (!AddMapping(Profile->Keys, &Profile->KeyCount, Values[0], Element))
+			goto too_many;
+	}
+	else if (strcmp(Directive, "rect") == 0)
+	{
+		if (WordCount != 6 || !ParseId(Words[1], ElementIds, ELEMENT_COUNT, &Element))
+			goto usage;
+		for (i = 0; i < 4; i++)
+			if (!ParseNumber(Words[2 + i], 0, 4095, &Values[i]))
+				goto usage;
+		Profile->Elements[Element].Rect.X = Values[0];
+		Profile->Elements[Element].Rect.Y = Values[1];
+		Profile->Elements[Element].Rect.W = Values[2];
+		Profile->Elements[Element].Rect.H = Values[3];
+	}
+	else if (strcmp(Directive, "color") == 0)
+	{
+		if (WordCount != 8 || !ParseId(Words[1], ElementIds, ELEMENT_COUNT, &Element))
+			goto usage;
+		for (i = 0; i < 6; i++)
+			if (!ParseNumber(Words[2 + i], 0, 255, &Values[i]))
+				goto usage;
+		struct ProfileColor Pressed = { Values[0], Values[1], Values[2] };
+		struct ProfileColor EverPressed = { Values[3], Values[4], Values[5] };
+		Profile->Elements[Element].ColorPressed = Pressed;
+		Profile->Elements[Element].ColorEverPressed = EverPressed;
+	}
+	else
+	{
+		printf("%s:%u: Unknown directive \"%s\"\n", Path, LineNumber, Directive);
+		return false;
+	}
+	return true;
+
+usage:
+	printf("%s:%u: Invalid \"%s\" line\n", Path, LineNumber, Directive);
+	return false;
+too_many:
+	printf("%s:%u: Too many mappings (at most %u)\n", Path, LineNumber, PROFILE_MAPPING_MAX);
+	return false;
+}
+
+bool ParseProfiles(FILE* File, const char* Path, KeyLookup LookUpKey, const struct Profile* Base, struct Profile* Profiles, unsigned int* Count)
+{
+	char Line[LINE_MAX_LENGTH];
+	struct Parser Parser = {
+		.Path = Path, .LineNumber = 0, .LookUpKey = LookUpKey,
+		.Base = Base, .Profiles = Profiles, .Count = Count, .Profile = NULL
+	};
+
+	*Count = 0;
+
+	while (fgets(Line, sizeof(Line), File) != NULL)
+	{
+		Parser.LineNumber++;
+		if (!ParseLine(&Parser, Line))
+			return false;
+	}
+
+	if (ferror(File))
+	{
+		printf("%s: Read error\n", Path);
+		return false;
+	}
+
+	return true;
+}
+
+bool ParseProfileText(const char* Text, const char* Path, KeyLookup LookUpKey, const struct Profile* Base, struct Profile* Profiles, unsigned int* Count)
+{
+	char Line[LINE_MAX_LENGTH];
+	struct Parser Parser = {
+		.Path = Path, .LineNumber = 0, .LookUpKey = LookUpKey,
+		.Base = Base, .Profiles = Profiles, .Count = Count, .Profile = NULL
+	};
+
+	*Count = 0;
+
+	while (*Text != '\0')
+	{
+		size_t Length = strcspn(Text, "\n");
+		if (Length >= sizeof(Line))
+		{
+			printf("%s:%u: Line too long\n", Path, Parser.LineNumber + 1);
+			return false;
+		}
+		memcpy(Line, Text, Length);
+		Line[Length] = '\0';
+		Text += Length;
+		if (*Text == '\n')
+			Text++;
+
+		Parser.LineNumber++;
+		if (!ParseLine(&Parser, Line))
+			return false;
+	}
+
+	return true;
+}
+
+bool DeviceMatches(const struct Profile* Profile, enum Device Device, const char* Name)
+{
+	const char* Pattern = Profile->Devices[Device].NamePattern;
+	return Pattern[0] != '\0' && fnmatch(Pattern, Name, 0) == 0;
+}
+
+void CompileProfile(const struct Profile* Profile, struct DispatchTables* Tables)
+{
+	unsigned int i, Device;
+
+	memset(Tables->KeyElements, ELEMENT_NONE, sizeof(Tables->KeyElements));
+	memset(Tables->ButtonElements, ELEMENT_NONE, sizeof(Tables->ButtonElements));
+	memset(Tables->AxisTargets, AXIS_NONE, sizeof(Tables->AxisTargets));
+	memset(Tables->DPadHats, 0, sizeof(Tables->DPadHats));
+
+	// Later mappings take precedence over earlier ones for the same code.
+	for (i = 0; i < Profile->KeyCount; i++)
+		Tables->KeyElements[Profile->Keys[i].Code] = Profile->Keys[i].Element;
+
+	for (Device = 0; Device < DEVICE_COUNT; Device++)
+	{
+		const struct DeviceProfile* Source = &Profile->Devices[Device];
+
+		for (i = 0; i < Source->ButtonCount; i++)
+			Tables->ButtonElements[Device][Source->Buttons[i].Code] = Source->Buttons[i].Element;
+		for (i = 0; i < AXIS_COUNT; i++)
+			if (Source->Axes[i] >= 0)
+				Tables->AxisTargets[Device][Source->Axes[i]] = i;
+		if (Source->DPadHat >= 0)
+			Tables->DPadHats[Device][Source->DPadHat] = true;
+	}
+}
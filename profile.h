@@ -0,0 +1,99 @@
+/* GCW Zero input tester, device profiles
+ *
+ * Copyright (C) 2014 Nebuleon Fumika <nebuleon@gcw-zero.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "input.h"
+
+#define PROFILE_NAME_MAX      64
+#define PROFILE_PATTERN_MAX  128
+#define PROFILE_MAPPING_MAX   64
+#define PROFILE_MAX           16
+
+struct Mapping {
+	int     Code;
+	uint8_t Element;
+};
+
+struct DeviceProfile {
+	/* fnmatch(3) pattern for the joystick's name. Empty if the profile does
+	 * not use this device. */
+	char           NamePattern[PROFILE_PATTERN_MAX];
+	int            Axes[AXIS_COUNT]; /* -1 if unused */
+	int            DPadHat; /* -1 if unused */
+	struct Mapping Buttons[PROFILE_MAPPING_MAX];
+	unsigned int   ButtonCount;
+};
+
+/* These do not use SDL's types, so that profiles can be read and compiled
+ * without SDL. */
+struct ProfileRect {
+	int X, Y, W, H;
+};
+
+struct ProfileColor {
+	uint8_t R, G, B;
+};
+
+struct ElementLayout {
+	struct ProfileRect  Rect;
+	struct ProfileColor ColorPressed;
+	struct ProfileColor ColorEverPressed;
+};
+
+struct Profile {
+	char                 Name[PROFILE_NAME_MAX];
+	struct DeviceProfile Devices[DEVICE_COUNT];
+	struct Mapping       Keys[PROFILE_MAPPING_MAX];
+	unsigned int         KeyCount;
+	struct ElementLayout Elements[ELEMENT_COUNT];
+};
+
+/* Looks up a key by its name, ignoring case. Returns true and sets *Code to
+ * the key code found in key events if the name is known; false otherwise.
+ * The parser rejects codes that are not below KEY_TABLE_SIZE. */
+typedef bool (*KeyLookup)(const char* Name, int* Code);
+
+/* Reads profiles from an open file. Each profile starts out with the element
+ * layout of Base and no mappings. Key names are resolved with LookUpKey.
+ * Problems are reported on standard output along with the line they occur on.
+ * Returns true on success, in which case *Count is set to the number of
+ * profiles read; false on failure. */
+extern bool ParseProfiles(FILE* File, const char* Path, KeyLookup LookUpKey, const struct Profile* Base, struct Profile* Profiles, unsigned int* Count);
+
+/* The same, from a string; Path only names it in reports. */
+extern bool ParseProfileText(const char* Text, const char* Path, KeyLookup LookUpKey, const struct Profile* Base, struct Profile* Profiles, unsigned int* Count);
+
+/* The profile used when none in the profile file matches the joysticks
+ * found, in the format read by ParseProfiles. Its element layout comes from
+ * the Base given to the parser. */
+extern const char BuiltInProfile[];
+
+/* Returns true if a joystick with the given name is the given device in the
+ * given profile. */
+extern bool DeviceMatches(const struct Profile* Profile, enum Device Device, const char* Name);
+
+extern void CompileProfile(const struct Profile* Profile, struct DispatchTables* Tables);
+
+#endif /* !PROFILE_H */
@@ -17,8 +17,13 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
 
 #if defined SDL_1
 #  define SDL_VER_STR "1.2"
@@ -35,96 +40,9 @@
 #endif
 #include "SDL_ttf.h"
 
-/* - - - DATA DEFINITIONS - - - */
-
-/* Binary elements (pressed or not) that are shown on the display. */
-enum Element {
-	ELEMENT_DPAD_UP,
-	ELEMENT_DPAD_DOWN,
-	ELEMENT_DPAD_LEFT,
-	ELEMENT_DPAD_RIGHT,
-	ELEMENT_Y,
-	ELEMENT_B,
-	ELEMENT_X,
-	ELEMENT_A,
-	ELEMENT_SELECT,
-	ELEMENT_START,
-	ELEMENT_L,
-	ELEMENT_R,
-	ELEMENT_POWER,
-	ELEMENT_HOLD,
-};
-#define ELEMENT_COUNT   14
+#include "profile.h"
 
-/* These define the keys that are not covered by JS 0, or used when the
- * GCW Zero's buttons are not being mapped to JS 0. */
-#ifdef SDL_1
-SDLKey KeysHavingElements[ELEMENT_COUNT] = {
-	SDLK_LEFT,
-	SDLK_RIGHT,
-	SDLK_UP,
-	SDLK_DOWN,
-	SDLK_LCTRL,
-	SDLK_LALT,
-	SDLK_LSHIFT,
-	SDLK_SPACE,
-	SDLK_TAB,
-	SDLK_BACKSPACE,
-	SDLK_ESCAPE,
-	SDLK_RETURN,
-	SDLK_HOME,
-	SDLK_PAUSE,
-};
-#else
-SDL_Scancode KeysHavingElements[ELEMENT_COUNT] = {
-	SDL_SCANCODE_LEFT,
-	SDL_SCANCODE_RIGHT,
-	SDL_SCANCODE_UP,
-	SDL_SCANCODE_DOWN,
-	SDL_SCANCODE_LCTRL,
-	SDL_SCANCODE_LALT,
-	SDL_SCANCODE_LSHIFT,
-	SDL_SCANCODE_SPACE,
-	SDL_SCANCODE_TAB,
-	SDL_SCANCODE_BACKSPACE,
-	SDL_SCANCODE_ESCAPE,
-	SDL_SCANCODE_RETURN,
-	SDL_SCANCODE_HOME,
-	SDL_SCANCODE_PAUSE,
-};
-#endif
-
-/* These define the elements that should be lit up by pressing the above keys,
- * ordered in the same way as in KeysHavingElements. */
-enum Element KeysToElements[ELEMENT_COUNT] = {
-	ELEMENT_DPAD_LEFT,
-	ELEMENT_DPAD_RIGHT,
-	ELEMENT_DPAD_UP,
-	ELEMENT_DPAD_DOWN,
-	ELEMENT_A,
-	ELEMENT_B,
-	ELEMENT_X,
-	ELEMENT_Y,
-	ELEMENT_L,
-	ELEMENT_R,
-	ELEMENT_SELECT,
-	ELEMENT_START,
-	ELEMENT_POWER,
-	ELEMENT_HOLD,
-};
-
-/* These define the elements that should be lit up by pressing JS 0's
- * buttons. */
-enum Element JoyButtonsToElements[8] = {
-	ELEMENT_B,
-	ELEMENT_A,
-	ELEMENT_Y,
-	ELEMENT_X,
-	ELEMENT_SELECT,
-	ELEMENT_START,
-	ELEMENT_L,
-	ELEMENT_R,
-};
+/* - - - DATA DEFINITIONS - - - */
 
 const char* ElementNames[ELEMENT_COUNT] = {
 	"D-pad Up",
@@ -144,16 +62,10 @@ const char* ElementNames[ELEMENT_COUNT] = {
 };
 
 /* Last readings for all the elements and axes. */
-bool ElementPressed[ELEMENT_COUNT];
-bool ElementEverPressed[ELEMENT_COUNT];
+struct InputState Input;
 
 bool DPadOppositeEverPressed = false;
 
-int16_t BuiltInJS_X = 0;
-int16_t BuiltInJS_Y = 0;
-int16_t GSensorJS_X = 0;
-int16_t GSensorJS_Y = 0;
-
 struct DrawnElement {
 	      SDL_Rect   Rect;
 	const SDL_Color* ColorPressed;
@@ -179,8 +91,41 @@ SDL_RASTER_TYPE TextExit;
 
 TTF_Font* Font = NULL;
 
+#ifdef SDL_1
+/* Colour depth of the screen; 16 matches the GCW Zero's panel. */
+int ScreenBPP = 32;
+#endif
+
+/* Benchmark mode draws frames as fast as possible and reports timings. */
+bool Benchmark = false;
+bool BenchmarkSkipPresent = false;
+
+/* If not NULL, every input event is also written there, to be replayed by
+ * input-bench. */
+FILE* RecordFile = NULL;
+
+SDL_Joystick* Joysticks[DEVICE_COUNT];
+
+/* Maps joystick numbers found in events (indices in SDL 1.2, instance IDs in
+ * SDL 2.0) to the device they are used as, or DEVICE_NONE. */
+#define JOYSTICK_ID_COUNT 256
+uint8_t JoystickDevices[JOYSTICK_ID_COUNT];
+
+struct Profile Profiles[PROFILE_MAX];
+struct Profile DefaultProfile;
+struct Profile* ActiveProfile;
+struct DispatchTables Dispatch;
+
+/* The active profile's element layout in SDL's types, as set by
+ * LayoutScreen. */
+SDL_Rect ElementRects[ELEMENT_COUNT];
+SDL_Color ElementColorsPressed[ELEMENT_COUNT];
+SDL_Color ElementColorsEverPressed[ELEMENT_COUNT];
+
 /* - - - CUSTOMISATION - - - */
 
+#define PROFILE_FILE     "profiles.cfg"
+
 #define FONT_FILE        "/usr/share/fonts/truetype/dejavu/DejaVuSansCondensed.ttf"
 #define FONT_SIZE         12
 
@@ -238,7 +183,11 @@ const SDL_Color ColorEverGravity  = {  64,  48,  32, 255 };
 const SDL_Color ColorEverFace     = {  32,  32,  64, 255 };
 const SDL_Color ColorEverOthers   = {  64,  32,  64, 255 };
 
-struct DrawnElement DrawnElements[ELEMENT_COUNT] = {
+const SDL_Color ColorPolled       = { 255, 255, 255, 255 };
+
+/* The layout that every profile starts out with. The built-in profile's
+ * mappings are in profile.c. */
+struct DrawnElement DefaultDrawnElements[ELEMENT_COUNT] = {
 	{ .Rect = { .x = 32, .y = 38 + GCW_ZERO_PIC_Y, .w = 14, .h = 16 }, .ColorPressed = &ColorCross, .ColorEverPressed = &ColorEverCross },
 	{ .Rect = { .x = 32, .y = 68 + GCW_ZERO_PIC_Y, .w = 14, .h = 16 }, .ColorPressed = &ColorCross, .ColorEverPressed = &ColorEverCross },
 	{ .Rect = { .x = 16, .y = 54 + GCW_ZERO_PIC_Y, .w = 16, .h = 14 }, .ColorPressed = &ColorCross, .ColorEverPressed = &ColorEverCross },
@@ -260,13 +209,13 @@ struct DrawnElement DrawnElements[ELEMENT_COUNT] = {
 bool MustExit(void)
 {
 	// Start+Select allows exiting this application.
-	return ElementPressed[ELEMENT_SELECT] && ElementPressed[ELEMENT_START];
+	return Input.ElementPressed[ELEMENT_SELECT] && Input.ElementPressed[ELEMENT_START];
 }
 
 #ifndef SDL_1
 void UpdateHaptic(void)
 {
-	bool NewHapticActive = ElementPressed[ELEMENT_L] && ElementPressed[ELEMENT_R];
+	bool NewHapticActive = Input.ElementPressed[ELEMENT_L] && Input.ElementPressed[ELEMENT_R];
 
 	if (!HapticActive && NewHapticActive)
 	{
@@ -315,9 +264,79 @@ static int HEIGHT(SDL_RASTER_TYPE Raster)
 #  define JOYSTICK_NAME(Index) SDL_JoystickName(Index)
 #  define JOYSTICK_INDEX(Joystick) SDL_JoystickIndex(Joystick)
 #  define SDL_COLOR(Source) SDL_MapRGB(Screen->format, (Source).r, (Source).g, (Source).b)
+
+/* Whether FillRect16 draws the filled rectangles, rather than SDL_FillRect.
+ * Decided for each video mode. */
+bool UseFillRect16 = false;
+
+/* Whether the screen is locked for FillRect16. Blits need it unlocked, so it
+ * is locked lazily by the first fill after one and unlocked before the next
+ * blit or the end of the frame. */
+bool ScreenLocked = false;
+
+static bool LockScreen(void)
+{
+	if (ScreenLocked || !SDL_MUSTLOCK(Screen))
+		return true;
+	if (SDL_LockSurface(Screen) < 0)
+		return false;
+	ScreenLocked = true;
+	return true;
+}
+
+static void UnlockScreen(void)
+{
+	if (ScreenLocked)
+	{
+		SDL_UnlockSurface(Screen);
+		ScreenLocked = false;
+	}
+}
+
+// Sets the video mode at the given depth. Rasters made by MAKE_STATIC_RASTER
+// are in the format of the previous mode, so they must be made again.
+static bool SetVideoMode(int BPP)
+{
+	UnlockScreen();
+	Screen = SDL_SetVideoMode(SCREEN_WIDTH, SCREEN_HEIGHT, BPP, SDL_HWSURFACE |
+#ifdef SDL_TRIPLEBUF
+		SDL_TRIPLEBUF
+#else
+		SDL_DOUBLEBUF
+#endif
+		);
+
+	if (Screen == NULL)
+	{
+		printf("SDL_SetVideoMode failed: %s\n", SDL_GetError());
+		return false;
+	}
+	// Hardware fills are left to SDL_FillRect.
+	UseFillRect16 = Screen->format->BytesPerPixel == 2
+		&& !((Screen->flags & SDL_HWSURFACE) && SDL_GetVideoInfo()->blit_fill);
+	return true;
+}
+
 #  define MAKE_RASTER(Surface) Surface
+
+// Converts text that is drawn every frame for the whole run to the screen's
+// format once, so that blits need not convert every pixel every time. Text is
+// antialiased, so its alpha is kept, and RLE acceleration stores the
+// converted pixels run-length encoded in the format of the screen. Rasters
+// made for a single frame are not worth converting.
+static SDL_RASTER_TYPE MAKE_STATIC_RASTER(SDL_Surface* Surface)
+{
+	SDL_RASTER_TYPE Result = SDL_DisplayFormatAlpha(Surface);
+	if (Result == NULL)
+		return Surface;
+	SDL_FreeSurface(Surface);
+	SDL_SetAlpha(Result, SDL_SRCALPHA | SDL_RLEACCEL, SDL_ALPHA_OPAQUE);
+	return Result;
+}
+
 #  define FREE_RASTER(Raster) SDL_FreeSurface(Raster)
 #  define PRESENT() SDL_Flip(Screen)
+#  define CREATE_THREAD(Function, Name, Data) SDL_CreateThread(Function, Data)
 #else
 #  define JOYSTICK_NAME(Index) SDL_JoystickNameForIndex(Index)
 #  define JOYSTICK_INDEX(Joystick) SDL_JoystickInstanceID(Joystick)
@@ -330,8 +349,58 @@ static SDL_RASTER_TYPE MAKE_RASTER(SDL_Surface* Surface)
 	return Result;
 }
 
+#  define MAKE_STATIC_RASTER(Surface) MAKE_RASTER(Surface)
 #  define FREE_RASTER(Raster) SDL_DestroyTexture(Raster)
 #  define PRESENT() SDL_RenderPresent(Renderer)
+#  define CREATE_THREAD(Function, Name, Data) SDL_CreateThread(Function, Name, Data)
+#endif
+
+#ifdef SDL_1
+// Fills a rectangle on a 16-bit software screen, storing two pixels at a time
+// wherever a row allows it, as SDL_FillRect does. What is saved is the lock
+// and unlock of the screen that SDL_FillRect does on every call: a frame
+// fills a few dozen small rectangles, four per hollow one, and the screen is
+// locked once for all of those between two blits instead.
+static void FillRect16(const SDL_Rect* DestRect, Uint16 Color)
+{
+	const SDL_Rect* Clip = &Screen->clip_rect;
+	int Left = DestRect->x < Clip->x ? Clip->x : DestRect->x;
+	int Top = DestRect->y < Clip->y ? Clip->y : DestRect->y;
+	int Right = DestRect->x + DestRect->w > Clip->x + Clip->w ? Clip->x + Clip->w : DestRect->x + DestRect->w;
+	int Bottom = DestRect->y + DestRect->h > Clip->y + Clip->h ? Clip->y + Clip->h : DestRect->y + DestRect->h;
+	Uint32 Pair = Color | ((Uint32) Color << 16);
+	int y;
+
+	if (Left >= Right || Top >= Bottom)
+		return;
+	if (!LockScreen())
+		return;
+
+	Uint8* Row = (Uint8*) Screen->pixels + Top * Screen->pitch + Left * 2;
+	for (y = Top; y < Bottom; y++, Row += Screen->pitch)
+	{
+		Uint16* Pixel = (Uint16*) Row;
+		int Count = Right - Left;
+		if ((uintptr_t) Pixel & 2)
+		{
+			*Pixel++ = Color;
+			Count--;
+		}
+		Uint32* Pixels = (Uint32*) Pixel;
+		for (; Count >= 2; Count -= 2)
+			*Pixels++ = Pair;
+		if (Count != 0)
+			*(Uint16*) Pixels = Color;
+	}
+}
+
+static void FILL_RECT(SDL_Rect* DestRect, Uint32 MappedColor)
+{
+	if (UseFillRect16)
+		FillRect16(DestRect, MappedColor);
+	else
+		SDL_FillRect(Screen, DestRect, MappedColor);
+}
 #endif
 
 static void RENDER_HOLLOW_RECT(SDL_Rect* DestRect, const SDL_Color* Color)
@@ -340,15 +409,15 @@ static void RENDER_HOLLOW_RECT(SDL_Rect* DestRect, const SDL_Color* Color)
 	Uint32 MappedColor = SDL_COLOR(*Color);
 	{
 		SDL_Rect LineRect = { .x = DestRect->x, .y = DestRect->y, .w = DestRect->w, .h = 1 };
-		SDL_FillRect(Screen, &LineRect, MappedColor);
+		FILL_RECT(&LineRect, MappedColor);
 		LineRect.y = DestRect->y + DestRect->h - 1;
-		SDL_FillRect(Screen, &LineRect, MappedColor);
+		FILL_RECT(&LineRect, MappedColor);
 	}
 	{
 		SDL_Rect LineRect = { .x = DestRect->x, .y = DestRect->y, .w = 1, .h = DestRect->h };
-		SDL_FillRect(Screen, &LineRect, MappedColor);
+		FILL_RECT(&LineRect, MappedColor);
 		LineRect.x = DestRect->x + DestRect->w - 1;
-		SDL_FillRect(Screen, &LineRect, MappedColor);
+		FILL_RECT(&LineRect, MappedColor);
 	}
 #else
 	SDL_SetRenderDrawColor(Renderer, SDL_COLOR(*Color));
@@ -359,16 +428,42 @@ static void RENDER_HOLLOW_RECT(SDL_Rect* DestRect, const SDL_Color* Color)
 static void RENDER_FILLED_RECT(SDL_Rect* DestRect, const SDL_Color* Color)
 {
 #ifdef SDL_1
-	SDL_FillRect(Screen, DestRect, SDL_COLOR(*Color));
+	FILL_RECT(DestRect, SDL_COLOR(*Color));
 #else
 	SDL_SetRenderDrawColor(Renderer, SDL_COLOR(*Color));
 	SDL_RenderFillRect(Renderer, DestRect);
 #endif
 }
 
+static void RENDER_FILLED_RECTS(SDL_Rect* DestRects, unsigned int Count, const SDL_Color* Color)
+{
+#ifdef SDL_1
+	Uint32 MappedColor = SDL_COLOR(*Color);
+	unsigned int i;
+	for (i = 0; i < Count; i++)
+		FILL_RECT(&DestRects[i], MappedColor);
+#else
+	SDL_SetRenderDrawColor(Renderer, SDL_COLOR(*Color));
+	SDL_RenderFillRects(Renderer, DestRects, Count);
+#endif
+}
+
+static void RENDER_HOLLOW_RECTS(SDL_Rect* DestRects, unsigned int Count, const SDL_Color* Color)
+{
+#ifdef SDL_1
+	unsigned int i;
+	for (i = 0; i < Count; i++)
+		RENDER_HOLLOW_RECT(&DestRects[i], Color);
+#else
+	SDL_SetRenderDrawColor(Renderer, SDL_COLOR(*Color));
+	SDL_RenderDrawRects(Renderer, DestRects, Count);
+#endif
+}
+
 static void RENDER_RASTER(SDL_RASTER_TYPE Raster, SDL_Rect* DestRect)
 {
 #ifdef SDL_1
+	UnlockScreen();
 	SDL_BlitSurface(Raster, NULL, Screen, DestRect);
 #else
 	SDL_RenderCopy(Renderer, Raster, NULL, DestRect);
@@ -380,12 +475,12 @@ static void RENDER_RASTER(SDL_RASTER_TYPE Raster, SDL_Rect* DestRect)
 // The caller is required to free this raster after it calls PRESENT(),
 // because the renderer may defer drawing it until presentation occurs
 // and another texture may be allocated on top if it is freed straight away.
-static SDL_RASTER_TYPE DrawJoystickDot(const Sint16 JoystickX, const Sint16 JoystickY, const Sint16 CX, const Sint16 Y, SDL_RASTER_TYPE Text, const SDL_Color* Color)
+static SDL_RASTER_TYPE DrawJoystickDot(const Sint16 JoystickX, const Sint16 JoystickY, const SDL_Rect* LabelRect, SDL_RASTER_TYPE Label, const SDL_Color* Color)
 {
 	if (JoystickX != 0 || JoystickY != 0)
 	{
-		SDL_Rect TextRect = { .x = CX - WIDTH(Text) / 2, .y = Y, .w = WIDTH(Text), .h = HEIGHT(Text) };
-		RENDER_RASTER(Text, &TextRect);
+		SDL_Rect TextRect = *LabelRect;
+		RENDER_RASTER(Label, &TextRect);
 
 		SDL_Rect DotRect = {
 			.x = INNER_SCREEN_X + (Uint32) ((Sint32) JoystickX + 32768) * (INNER_SCREEN_W - 4) / 65536,
@@ -399,115 +494,1106 @@ static SDL_RASTER_TYPE DrawJoystickDot(const Sint16 JoystickX, const Sint16 Joys
 		char Coords[20];
 		sprintf(Coords, "(%.2f, %.2f)", JoystickX / 32767.0, JoystickY / 32767.0);
 		SDL_Surface* Surface = TTF_RenderUTF8_Blended(Font, Coords, *Color);
+		SDL_Rect CoordsRect = { .x = DotRect.x, .y = DotRect.y, .w = Surface->w, .h = Surface->h };
 		SDL_RASTER_TYPE TextCoords = MAKE_RASTER(Surface);
-		SDL_Rect CoordsRect = { .x = DotRect.x, .y = DotRect.y, .w = WIDTH(TextCoords), .h = HEIGHT(TextCoords) };
 		if (JoystickX < 0)
 			CoordsRect.x += 8;
 		else
-			CoordsRect.x -= WIDTH(TextCoords) + 4;
+			CoordsRect.x -= CoordsRect.w + 4;
 		if (JoystickY < 0)
 			CoordsRect.y += 4;
 		else
-			CoordsRect.y -= HEIGHT(TextCoords) + 2;
+			CoordsRect.y -= CoordsRect.h + 2;
 		RENDER_RASTER(TextCoords, &CoordsRect);
 		return TextCoords;
 	}
 	else return NULL;
 }
 
-/* - - - DISPLAY AND INPUT - - - */
+/* - - - DEVICE PROFILES - - - */
 
-static void DrawScreen()
+/* Key codes, as found in key events, that can be mapped to elements. */
+#ifdef SDL_1
+#  define KEY_CODE_COUNT  SDLK_LAST
+#else
+#  define KEY_CODE_COUNT  SDL_NUM_SCANCODES
+#endif
+
+/* Profiles cannot map key codes past KEY_TABLE_SIZE, so a newer SDL with more
+ * key codes than the table holds must fail to compile. */
+typedef char KeyTableFits[KEY_CODE_COUNT <= KEY_TABLE_SIZE ? 1 : -1];
+
+// Resolves key names in profiles with SDL's own names.
+static bool LookUpSDLKey(const char* Name, int* Code)
+{
+#ifdef SDL_1
+	int Key;
+	for (Key = SDLK_FIRST; Key < SDLK_LAST; Key++)
+	{
+		if (strcasecmp(Name, SDL_GetKeyName(Key)) == 0)
+		{
+			*Code = Key;
+			return true;
+		}
+	}
+	return false;
+#else
+	*Code = SDL_GetScancodeFromName(Name);
+	return *Code != SDL_SCANCODE_UNKNOWN;
+#endif
+}
+
+// Parses the built-in profile over the built-in layout. Returns false if that
+// fails, which would be a bug.
+static bool MakeDefaultProfile(struct Profile* Profile)
+{
+	unsigned int i, Count;
+
+	memset(Profile, 0, sizeof(*Profile));
+	for (i = 0; i < ELEMENT_COUNT; i++)
+	{
+		const struct DrawnElement* Source = &DefaultDrawnElements[i];
+		struct ElementLayout* Layout = &Profile->Elements[i];
+
+		Layout->Rect.X = Source->Rect.x;
+		Layout->Rect.Y = Source->Rect.y;
+		Layout->Rect.W = Source->Rect.w;
+		Layout->Rect.H = Source->Rect.h;
+		Layout->ColorPressed.R = Source->ColorPressed->r;
+		Layout->ColorPressed.G = Source->ColorPressed->g;
+		Layout->ColorPressed.B = Source->ColorPressed->b;
+		Layout->ColorEverPressed.R = Source->ColorEverPressed->r;
+		Layout->ColorEverPressed.G = Source->ColorEverPressed->g;
+		Layout->ColorEverPressed.B = Source->ColorEverPressed->b;
+	}
+
+	// Profiles is only used as room to parse into, as the profile file has
+	// not been read yet.
+	if (!ParseProfileText(BuiltInProfile, "built-in profile", LookUpSDLKey, Profile, Profiles, &Count) || Count != 1)
+		return false;
+	*Profile = Profiles[0];
+	return true;
+}
+
+// Reads the profile file, if any. Returns false if it exists but is invalid.
+// If the file at the default path does not exist, that is not an error.
+static bool LoadProfiles(const char* Path, bool Explicit, unsigned int* Count)
+{
+	*Count = 0;
+
+	FILE* File = fopen(Path, "r");
+	if (File == NULL)
+	{
+		if (Explicit)
+		{
+			printf("Opening %s failed: %s\n", Path, strerror(errno));
+			return false;
+		}
+		printf("No profile file at %s; using the built-in profile\n", Path);
+		return true;
+	}
+
+	bool Result = ParseProfiles(File, Path, LookUpSDLKey, &DefaultProfile, Profiles, Count);
+	fclose(File);
+	if (Result)
+		printf("Read %u profile(s) from %s\n", *Count, Path);
+	return Result;
+}
+
+// Returns the first profile in the file that uses any of the joysticks that
+// are connected, or that uses no joysticks at all. Falls back to the built-in
+// profile.
+static struct Profile* SelectProfile(unsigned int Count)
 {
+	unsigned int i, j, Device;
+
+	for (i = 0; i < Count; i++)
+	{
+		bool UsesJoysticks = false;
+		for (Device = 0; Device < DEVICE_COUNT; Device++)
+		{
+			if (Profiles[i].Devices[Device].NamePattern[0] == '\0')
+				continue;
+			UsesJoysticks = true;
+			for (j = 0; j < (unsigned int) SDL_NumJoysticks(); j++)
+				if (DeviceMatches(&Profiles[i], Device, JOYSTICK_NAME(j)))
+					return &Profiles[i];
+		}
+		if (!UsesJoysticks)
+			return &Profiles[i];
+	}
+
+	return &DefaultProfile;
+}
+
+static uint8_t JoystickDevice(int Which)
+{
+	return (unsigned int) Which < JOYSTICK_ID_COUNT ? JoystickDevices[Which] : DEVICE_NONE;
+}
+
+/* - - - FIXED-RATE POLLING - - - */
+
+/* In polling mode, a thread samples the joysticks directly at a steady rate
+ * instead of waiting for SDL to deliver events about them. The samples are
+ * handed to the renderer through a single-producer, single-consumer ring,
+ * and the renderer compares them against the event-derived state. */
+
+#define POLL_RATE_MAX    1000
+
+/* Must be a power of two. This holds over a second of samples at the maximum
+ * rate, so the renderer can be stalled for quite a while before any samples
+ * are dropped. */
+#define POLL_RING_SIZE   1024
+
+struct PollSample {
+	uint64_t Time; /* CLOCK_MONOTONIC, in nanoseconds */
+	uint16_t Pressed; /* bit N is set if element N is pressed */
+	int16_t  Axes[DEVICE_COUNT][AXIS_COUNT];
+};
+
+struct PollRing {
+	struct PollSample Samples[POLL_RING_SIZE];
+	/* Only written by the polling thread. */
+	unsigned int Head __attribute__((aligned(64)));
+	/* Only written by the renderer. Kept on its own cache line so that the
+	 * two sides do not keep stealing the line from each other. */
+	unsigned int Tail __attribute__((aligned(64)));
+};
+
+/* Polling rate in Hz, or 0 if polling mode is disabled. */
+unsigned int PollRate = 0;
+
+struct PollRing PollSamples;
+
+/* Serialises SDL_JoystickUpdate between the polling thread and the event
+ * pump in the main thread. */
+SDL_mutex* JoystickMutex = NULL;
+SDL_Thread* PollThread = NULL;
+bool PollStop = false;
+
+/* Elements whose state can be read off the joysticks directly. */
+uint16_t PolledElements = 0;
+
+/* Polled elements pressed according to joystick events alone. Keys have no
+ * equivalent to SDL_JoystickGetButton, and they light up the same elements
+ * as the buttons do on the GCW Zero, so the state shown on the screen cannot
+ * be compared with polled samples. Only touched by the main thread. */
+uint16_t JoystickEventPressed = 0;
+
+#define DPAD_ELEMENTS ((1 << ELEMENT_DPAD_UP) | (1 << ELEMENT_DPAD_DOWN) \
+                     | (1 << ELEMENT_DPAD_LEFT) | (1 << ELEMENT_DPAD_RIGHT))
+
+/* Statistics. Those starting with PollThread are only written by the polling
+ * thread, and only read after it has been joined. */
+uint64_t PollThreadTicks = 0;
+uint64_t PollThreadLateTicks = 0;
+uint64_t PollThreadDropped = 0;
+uint64_t PollThreadCPUTime = 0;
+uint64_t PollThreadWallTime = 0;
+uint64_t PollSamplesRead = 0;
+uint64_t PollSamplesDisagreeing = 0;
+
+/* Changes to JoystickEventPressed, each stamped
+ * with the CLOCK_MONOTONIC time at which the main thread applied it. This
+ * lets each polled sample be compared with the event state that was in
+ * effect when the sample was taken, rather than the one at the time the
+ * renderer gets around to reading it. Only touched by the main thread.
+ * Must be a power of two. */
+#define EVENT_HISTORY_SIZE 256
+
+struct EventStateChange {
+	uint64_t Time;
+	uint16_t Pressed;
+};
+
+struct EventStateChange EventHistory[EVENT_HISTORY_SIZE];
+/* The entry at Tail is the oldest one still needed, the one at Head - 1 is
+ * the current state. */
+unsigned int EventHistoryHead = 0;
+unsigned int EventHistoryTail = 0;
+
+/* The latest sample read by the renderer. */
+struct PollSample LastPollSample;
+bool HaveLastPollSample = false;
+
+static uint64_t ClockNanoseconds(clockid_t Clock)
+{
+	struct timespec Time;
+	clock_gettime(Clock, &Time);
+	return (uint64_t) Time.tv_sec * 1000000000 + Time.tv_nsec;
+}
+
+static uint16_t EventPressedElements(void)
+{
+	uint16_t Result = 0;
+	unsigned int i;
+	for (i = 0; i < ELEMENT_COUNT; i++)
+		if (Input.ElementPressed[i])
+			Result |= 1 << i;
+	return Result;
+}
+
+// Updates JoystickEventPressed according to a joystick event, and records
+// it if it changed. Called after each event is applied.
+static void RecordEventState(const struct InputEvent* Event)
+{
+	uint16_t Pressed = JoystickEventPressed;
+	unsigned int Head = EventHistoryHead;
+	uint8_t Element;
+
+	if (Event->Device >= DEVICE_COUNT)
+		return;
+	switch (Event->Type)
+	{
+		case INPUT_HAT:
+			if (!Dispatch.DPadHats[Event->Device][Event->Index])
+				return;
+			Pressed &= ~DPAD_ELEMENTS;
+			if (Event->Value & HAT_UP)    Pressed |= 1 << ELEMENT_DPAD_UP;
+			if (Event->Value & HAT_DOWN)  Pressed |= 1 << ELEMENT_DPAD_DOWN;
+			if (Event->Value & HAT_LEFT)  Pressed |= 1 << ELEMENT_DPAD_LEFT;
+			if (Event->Value & HAT_RIGHT) Pressed |= 1 << ELEMENT_DPAD_RIGHT;
+			break;
+		case INPUT_BUTTON_DOWN:
+		case INPUT_BUTTON_UP:
+			Element = InputEventElement(&Dispatch, Event);
+			if (Element == ELEMENT_NONE)
+				return;
+			if (Event->Type == INPUT_BUTTON_DOWN)
+				Pressed |= 1 << Element;
+			else
+				Pressed &= ~(1 << Element);
+			break;
+		default:
+			return;
+	}
+
+	Pressed &= PolledElements;
+	if (Pressed == JoystickEventPressed)
+		return;
+	JoystickEventPressed = Pressed;
+	// If the renderer has fallen this far behind, the oldest change is
+	// forgotten, and samples older than the next one are compared with it.
+	if (Head - EventHistoryTail == EVENT_HISTORY_SIZE)
+		EventHistoryTail++;
+	EventHistory[Head & (EVENT_HISTORY_SIZE - 1)].Time = ClockNanoseconds(CLOCK_MONOTONIC);
+	EventHistory[Head & (EVENT_HISTORY_SIZE - 1)].Pressed = Pressed;
+	EventHistoryHead = Head + 1;
+}
+
+static void ReadPollSample(struct PollSample* Sample)
+{
+	unsigned int i, Device;
+
+	memset(Sample, 0, sizeof(*Sample));
+
+	for (Device = 0; Device < DEVICE_COUNT; Device++)
+	{
+		SDL_Joystick* Joystick = Joysticks[Device];
+		if (Joystick == NULL)
+			continue;
+
+		int ButtonCount = SDL_JoystickNumButtons(Joystick);
+		for (i = 0; i < (unsigned int) ButtonCount && i < JOY_INDEX_COUNT; i++)
+		{
+			uint8_t Element = Dispatch.ButtonElements[Device][i];
+			if (Element != ELEMENT_NONE && SDL_JoystickGetButton(Joystick, i))
+				Sample->Pressed |= 1 << Element;
+		}
+
+		int HatCount = SDL_JoystickNumHats(Joystick);
+		for (i = 0; i < (unsigned int) HatCount && i < JOY_INDEX_COUNT; i++)
+		{
+			if (!Dispatch.DPadHats[Device][i])
+				continue;
+			Uint8 Hat = SDL_JoystickGetHat(Joystick, i);
+			if (Hat & SDL_HAT_UP)    Sample->Pressed |= 1 << ELEMENT_DPAD_UP;
+			if (Hat & SDL_HAT_DOWN)  Sample->Pressed |= 1 << ELEMENT_DPAD_DOWN;
+			if (Hat & SDL_HAT_LEFT)  Sample->Pressed |= 1 << ELEMENT_DPAD_LEFT;
+			if (Hat & SDL_HAT_RIGHT) Sample->Pressed |= 1 << ELEMENT_DPAD_RIGHT;
+		}
+
+		for (i = 0; i < AXIS_COUNT; i++)
+		{
+			int Axis = ActiveProfile->Devices[Device].Axes[i];
+			if (Axis >= 0)
+				Sample->Axes[Device][i] = SDL_JoystickGetAxis(Joystick, Axis);
+		}
+	}
+}
+
+static int PollThreadMain(void* Data)
+{
+	const uint64_t Period = 1000000000 / PollRate;
+	uint64_t WallStart = ClockNanoseconds(CLOCK_MONOTONIC);
+	uint64_t CPUStart = ClockNanoseconds(CLOCK_THREAD_CPUTIME_ID);
+	uint64_t Deadline = WallStart;
+
+	while (!__atomic_load_n(&PollStop, __ATOMIC_ACQUIRE))
+	{
+		// Sleep until an absolute deadline, so that the time taken by each
+		// tick does not push the next one back.
+		Deadline += Period;
+		struct timespec DeadlineSpec = {
+			.tv_sec = Deadline / 1000000000,
+			.tv_nsec = Deadline % 1000000000
+		};
+		// clock_nanosleep returns its error number rather than setting errno.
+		// Only an interrupted sleep is retried; any other error is not going
+		// to go away, and the tick proceeds late instead of spinning.
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &DeadlineSpec, NULL) == EINTR);
+
+		struct PollSample Sample;
+		SDL_LockMutex(JoystickMutex);
+		SDL_JoystickUpdate();
+		ReadPollSample(&Sample);
+		SDL_UnlockMutex(JoystickMutex);
+		Sample.Time = ClockNanoseconds(CLOCK_MONOTONIC);
+
+		unsigned int Head = PollSamples.Head;
+		if (Head - __atomic_load_n(&PollSamples.Tail, __ATOMIC_ACQUIRE) < POLL_RING_SIZE)
+		{
+			PollSamples.Samples[Head & (POLL_RING_SIZE - 1)] = Sample;
+			__atomic_store_n(&PollSamples.Head, Head + 1, __ATOMIC_RELEASE);
+		}
+		else PollThreadDropped++;
+
+		PollThreadTicks++;
+		// If a whole period was missed, start over from now instead of
+		// trying to catch up with a burst of ticks.
+		if (Sample.Time > Deadline + Period)
+		{
+			PollThreadLateTicks++;
+			Deadline = Sample.Time;
+		}
+	}
+
+	PollThreadCPUTime = ClockNanoseconds(CLOCK_THREAD_CPUTIME_ID) - CPUStart;
+	PollThreadWallTime = ClockNanoseconds(CLOCK_MONOTONIC) - WallStart;
+	return 0;
+}
+
+static bool StartPolling(void)
+{
+	unsigned int i, Device;
+
+	PolledElements = 0;
+	for (Device = 0; Device < DEVICE_COUNT; Device++)
+	{
+		SDL_Joystick* Joystick = Joysticks[Device];
+		if (Joystick == NULL)
+			continue;
+
+		int ButtonCount = SDL_JoystickNumButtons(Joystick);
+		for (i = 0; i < (unsigned int) ButtonCount && i < JOY_INDEX_COUNT; i++)
+			if (Dispatch.ButtonElements[Device][i] != ELEMENT_NONE)
+				PolledElements |= 1 << Dispatch.ButtonElements[Device][i];
+
+		int HatCount = SDL_JoystickNumHats(Joystick);
+		for (i = 0; i < (unsigned int) HatCount && i < JOY_INDEX_COUNT; i++)
+			if (Dispatch.DPadHats[Device][i])
+				PolledElements |= DPAD_ELEMENTS;
+	}
+
+	// Nothing is pressed before the first event.
+	JoystickEventPressed = 0;
+	EventHistory[0].Time = 0;
+	EventHistory[0].Pressed = 0;
+	EventHistoryHead = 1;
+	EventHistoryTail = 0;
+
+	JoystickMutex = SDL_CreateMutex();
+	if (JoystickMutex == NULL)
+	{
+		printf("SDL_CreateMutex failed: %s\n", SDL_GetError());
+		return false;
+	}
+
+	PollThread = CREATE_THREAD(PollThreadMain, "Joystick polling", NULL);
+	if (PollThread == NULL)
+	{
+		printf("SDL_CreateThread failed: %s\n", SDL_GetError());
+		SDL_DestroyMutex(JoystickMutex);
+		JoystickMutex = NULL;
+		return false;
+	}
+
+	printf("Polling joysticks at %u Hz\n", PollRate);
+	return true;
+}
+
+static void StopPolling(void)
+{
+	__atomic_store_n(&PollStop, true, __ATOMIC_RELEASE);
+	SDL_WaitThread(PollThread, NULL);
+	SDL_DestroyMutex(JoystickMutex);
+	JoystickMutex = NULL;
+
+	double WallSeconds = PollThreadWallTime / 1e9;
+	printf("Polling report at %u Hz:\n", PollRate);
+	printf("  %llu ticks in %.2f s (%.1f Hz achieved), %llu late, %llu samples dropped\n",
+		(unsigned long long) PollThreadTicks, WallSeconds,
+		WallSeconds > 0 ? PollThreadTicks / WallSeconds : 0.0,
+		(unsigned long long) PollThreadLateTicks,
+		(unsigned long long) PollThreadDropped);
+	printf("  CPU time: %.2f ms (%.2f%% of one core, %.2f us per tick)\n",
+		PollThreadCPUTime / 1e6,
+		PollThreadWallTime > 0 ? 100.0 * PollThreadCPUTime / PollThreadWallTime : 0.0,
+		PollThreadTicks > 0 ? PollThreadCPUTime / 1e3 / PollThreadTicks : 0.0);
+	printf("  %llu samples read, %llu (%.2f%%) disagreeing with the event state at the time they were taken\n",
+		(unsigned long long) PollSamplesRead,
+		(unsigned long long) PollSamplesDisagreeing,
+		PollSamplesRead > 0 ? 100.0 * PollSamplesDisagreeing / PollSamplesRead : 0.0);
+}
+
+// Reads all of the samples the polling thread has produced since the last
+// call, comparing each of them to the state derived from joystick events that
+// had been applied by the time the sample was taken. Key events are left out.
+//
+// A disagreeing sample is one that saw a button or hat in a different state
+// than the events had reported by then. Since a change reaches the joystick
+// state and the event queue in the same SDL_JoystickUpdate, this mostly
+// measures how long events wait in the queue before the main thread applies
+// them, along with any events SDL drops or coalesces. Samples taken after the
+// last event was applied are compared with the current state, which may
+// still change when later events in the queue are applied; those are counted
+// as disagreeing too, as that is exactly the lag being measured.
+static void ReadPollSamples(void)
+{
+	unsigned int Tail = PollSamples.Tail;
+	unsigned int Head = __atomic_load_n(&PollSamples.Head, __ATOMIC_ACQUIRE);
+
+	for (; Tail != Head; Tail++)
+	{
+		const struct PollSample* Sample = &PollSamples.Samples[Tail & (POLL_RING_SIZE - 1)];
+
+		// Samples come in time order, so the history can be consumed as it
+		// goes; the entry in effect at this sample's time is kept for the
+		// next one.
+		while (EventHistoryHead - EventHistoryTail > 1
+		    && EventHistory[(EventHistoryTail + 1) & (EVENT_HISTORY_SIZE - 1)].Time <= Sample->Time)
+			EventHistoryTail++;
+		uint16_t EventPressed = EventHistory[EventHistoryTail & (EVENT_HISTORY_SIZE - 1)].Pressed;
+
+		if ((Sample->Pressed & PolledElements) != EventPressed)
+			PollSamplesDisagreeing++;
+		PollSamplesRead++;
+		if (Tail + 1 == Head)
+		{
+			LastPollSample = *Sample;
+			HaveLastPollSample = true;
+		}
+	}
+
+	__atomic_store_n(&PollSamples.Tail, Tail, __ATOMIC_RELEASE);
+}
+
+static void DrawPolledDot(const Sint16 JoystickX, const Sint16 JoystickY)
+{
+	if (JoystickX != 0 || JoystickY != 0)
+	{
+		SDL_Rect DotRect = {
+			.x = INNER_SCREEN_X + (Uint32) ((Sint32) JoystickX + 32768) * (INNER_SCREEN_W - 4) / 65536 - 1,
+			.y = GCW_ZERO_PIC_Y + INNER_SCREEN_Y + (Uint32) ((Sint32) JoystickY + 32768) * (INNER_SCREEN_H - 4) / 65536 - 1,
+			.w = 6,
+			.h = 6
+		};
+		RENDER_HOLLOW_RECT(&DotRect, &ColorPolled);
+	}
+}
+
+// Outlines the elements pressed according to the latest polled sample, and
+// the polled positions of the analog nub and gravity sensor.
+static void DrawPollSample(void)
+{
+	unsigned int i;
+
+	if (!HaveLastPollSample)
+		return;
+
+	for (i = 0; i < ELEMENT_COUNT; i++)
+	{
+		if (LastPollSample.Pressed & (1 << i))
+			RENDER_HOLLOW_RECT(&ElementRects[i], &ColorPolled);
+	}
+
+	DrawPolledDot(LastPollSample.Axes[DEVICE_BUILT_IN][AXIS_X], LastPollSample.Axes[DEVICE_BUILT_IN][AXIS_Y]);
+	DrawPolledDot(LastPollSample.Axes[DEVICE_G_SENSOR][AXIS_X], LastPollSample.Axes[DEVICE_G_SENSOR][AXIS_Y]);
+}
+
+static int PollEvent(SDL_Event* Event)
+{
+	int Result;
+	if (JoystickMutex == NULL)
+		return SDL_PollEvent(Event);
+	SDL_LockMutex(JoystickMutex);
+	Result = SDL_PollEvent(Event);
+	SDL_UnlockMutex(JoystickMutex);
+	return Result;
+}
+
+/* - - - LAYOUT - - - */
+
+/* Everything drawn at a fixed place is resolved once, after the text rasters
+ * are created, into a display list that DrawScreen walks every frame. */
+
+enum DrawKind {
+	DRAW_FILLED_RECT,
+	DRAW_HOLLOW_RECT,
+	DRAW_ELEMENT, /* filled, in a colour that depends on the element's state */
+	DRAW_RASTER,
+};
+
+enum DrawCondition {
+	SHOW_ALWAYS,
+	SHOW_IF_PRESSED, /* if any of Elements is pressed */
+	SHOW_IF_DPAD_OPPOSITE, /* if opposite directions were ever pressed at once */
+};
+
+struct DrawItem {
+	SDL_Rect         Rect;
+	SDL_RASTER_TYPE  Raster; /* DRAW_RASTER */
+	const SDL_Color* Color; /* DRAW_FILLED_RECT, DRAW_HOLLOW_RECT */
+	uint16_t         Elements; /* SHOW_IF_PRESSED */
+	uint8_t          Element; /* DRAW_ELEMENT */
+	uint8_t          Kind;
+	uint8_t          Condition;
+};
+
+#define DRAW_ITEM_MAX     32
+
+struct DrawItem DisplayList[DRAW_ITEM_MAX];
+unsigned int DisplayListLength = 0;
+
+/* Whether any two elements of the active profile overlap. If so, elements
+ * must be drawn in order, so that the later one stays on top. */
+bool ElementsOverlap = false;
+
+/* Where the labels for the joystick dots go, when they are shown. */
+SDL_Rect TextAnalogRect;
+SDL_Rect TextGravityRect;
+
+/* Rectangles of the same kind and colour, to be drawn with one call. */
+struct RectBatch {
+	const SDL_Color* Color;
+	uint8_t          Kind;
+	unsigned int     Count;
+	SDL_Rect         Rects[ELEMENT_COUNT];
+};
+
+static struct DrawItem* AddDrawItem(enum DrawKind Kind, int X, int Y, int W, int H)
+{
+	struct DrawItem* Item = &DisplayList[DisplayListLength++];
+	memset(Item, 0, sizeof(*Item));
+	Item->Kind = Kind;
+	Item->Rect.x = X;
+	Item->Rect.y = Y;
+	Item->Rect.w = W;
+	Item->Rect.h = H;
+	return Item;
+}
+
+static void AddRect(enum DrawKind Kind, int X, int Y, int W, int H, const SDL_Color* Color)
+{
+	AddDrawItem(Kind, X, Y, W, H)->Color = Color;
+}
+
+static void AddRaster(SDL_RASTER_TYPE Raster, int X, int Y, enum DrawCondition Condition, uint16_t Elements)
+{
+	struct DrawItem* Item = AddDrawItem(DRAW_RASTER, X, Y, WIDTH(Raster), HEIGHT(Raster));
+	Item->Raster = Raster;
+	Item->Condition = Condition;
+	Item->Elements = Elements;
+}
+
+static bool RectsOverlap(const SDL_Rect* A, const SDL_Rect* B)
+{
+	return A->x < B->x + B->w && B->x < A->x + A->w
+	    && A->y < B->y + B->h && B->y < A->y + A->h;
+}
+
+// Must be called again whenever the text rasters or the active profile
+// change.
+static void LayoutScreen(void)
+{
+	unsigned int i, j;
+
+	DisplayListLength = 0;
+
 	// Background
-	SDL_Rect ScreenRect = { .x = 0, .y = 0, .w = SCREEN_WIDTH, .h = SCREEN_HEIGHT };
-	RENDER_FILLED_RECT(&ScreenRect, &ColorBackground);
+	AddRect(DRAW_FILLED_RECT, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, &ColorBackground);
 
 	// Outer border (there to tell you whether your screen is being cut off by
 	// the bezel)
-	RENDER_HOLLOW_RECT(&ScreenRect, &ColorBorder);
+	AddRect(DRAW_HOLLOW_RECT, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, &ColorBorder);
 
 	// Elements
-	unsigned int i;
 	for (i = 0; i < ELEMENT_COUNT; i++)
 	{
-		RENDER_FILLED_RECT(&DrawnElements[i].Rect,
-			(ElementPressed[i] ? DrawnElements[i].ColorPressed :
-				(ElementEverPressed[i] ? DrawnElements[i].ColorEverPressed : &ColorNeverPressed)));
+		const struct ElementLayout* Layout = &ActiveProfile->Elements[i];
+		SDL_Rect* Rect = &ElementRects[i];
+		SDL_Color Pressed = { Layout->ColorPressed.R, Layout->ColorPressed.G, Layout->ColorPressed.B, 255 };
+		SDL_Color EverPressed = { Layout->ColorEverPressed.R, Layout->ColorEverPressed.G, Layout->ColorEverPressed.B, 255 };
+
+		Rect->x = Layout->Rect.X;
+		Rect->y = Layout->Rect.Y;
+		Rect->w = Layout->Rect.W;
+		Rect->h = Layout->Rect.H;
+		ElementColorsPressed[i] = Pressed;
+		ElementColorsEverPressed[i] = EverPressed;
+		AddDrawItem(DRAW_ELEMENT, Rect->x, Rect->y, Rect->w, Rect->h)->Element = i;
 	}
 
+	ElementsOverlap = false;
+	for (i = 0; i < ELEMENT_COUNT; i++)
+		for (j = i + 1; j < ELEMENT_COUNT; j++)
+			if (RectsOverlap(&ElementRects[i], &ElementRects[j]))
+				ElementsOverlap = true;
+
 	// Text prompt: Start+Select to exit
-	SDL_Rect TextExitRect = { .x = TEXT_EXIT_RX - WIDTH(TextExit), .y = TEXT_EXIT_Y, .w = WIDTH(TextExit), .h = HEIGHT(TextExit) };
-	RENDER_RASTER(TextExit, &TextExitRect);
+	AddRaster(TextExit, TEXT_EXIT_RX - WIDTH(TextExit), TEXT_EXIT_Y, SHOW_ALWAYS, 0);
 
 #ifndef SDL_1
 	// Text prompt: L+R to rumble
 	if (HapticDevice != NULL)
-	{
-		SDL_Rect TextRumbleRect = { .x = TEXT_RUMBLE_RX - WIDTH(TextRumble), .y = TEXT_RUMBLE_Y, .w = WIDTH(TextRumble), .h = HEIGHT(TextRumble) };
-		RENDER_RASTER(TextRumble, &TextRumbleRect);
-	}
+		AddRaster(TextRumble, TEXT_RUMBLE_RX - WIDTH(TextRumble), TEXT_RUMBLE_Y, SHOW_ALWAYS, 0);
 #endif
 
 	// Text prompt, if a direction is pressed on the cross
-	if (ElementPressed[0] || ElementPressed[1] || ElementPressed[2] || ElementPressed[3])
-	{
-		SDL_Rect TextCrossRect = { .x = TEXT_CROSS_LX, .y = TEXT_CROSS_Y, .w = WIDTH(TextCross), .h = HEIGHT(TextCross) };
-		RENDER_RASTER(TextCross, &TextCrossRect);
-	}
+	AddRaster(TextCross, TEXT_CROSS_LX, TEXT_CROSS_Y, SHOW_IF_PRESSED,
+		(1 << ELEMENT_DPAD_UP) | (1 << ELEMENT_DPAD_DOWN) | (1 << ELEMENT_DPAD_LEFT) | (1 << ELEMENT_DPAD_RIGHT));
 
 	// Text prompt, if ever during this run two opposite directions on the
-	// cross were pressed at once (this also maintains the status)
-	if ((ElementPressed[0] && ElementPressed[1]) || (ElementPressed[2] && ElementPressed[3]) || DPadOppositeEverPressed)
+	// cross were pressed at once
+	AddRaster(TextCrossError, TEXT_CROSS_ERR_LX, TEXT_CROSS_ERR_Y, SHOW_IF_DPAD_OPPOSITE, 0);
+
+	// Text prompt, if a face button is pressed
+	AddRaster(TextFace, TEXT_FACE_RX - WIDTH(TextFace), TEXT_FACE_Y, SHOW_IF_PRESSED,
+		(1 << ELEMENT_Y) | (1 << ELEMENT_B) | (1 << ELEMENT_X) | (1 << ELEMENT_A));
+
+	// Text prompt, if another button is pressed
+	AddRaster(TextOthers, TEXT_OTHERS_RX - WIDTH(TextOthers), TEXT_OTHERS_Y, SHOW_IF_PRESSED,
+		(1 << ELEMENT_SELECT) | (1 << ELEMENT_START) | (1 << ELEMENT_L) | (1 << ELEMENT_R) | (1 << ELEMENT_POWER) | (1 << ELEMENT_HOLD));
+
+	// Inner border (there to provide a reference frame for the joystick axes'
+	// dots)
+	AddRect(DRAW_HOLLOW_RECT, INNER_SCREEN_X, GCW_ZERO_PIC_Y + INNER_SCREEN_Y, INNER_SCREEN_W, INNER_SCREEN_H, &ColorInnerBorder);
+
+	SDL_Rect AnalogRect = { .x = TEXT_ANALOG_CX - WIDTH(TextAnalog) / 2, .y = TEXT_ANALOG_Y, .w = WIDTH(TextAnalog), .h = HEIGHT(TextAnalog) };
+	TextAnalogRect = AnalogRect;
+	SDL_Rect GravityRect = { .x = TEXT_GRAVITY_CX - WIDTH(TextGravity) / 2, .y = TEXT_GRAVITY_Y, .w = WIDTH(TextGravity), .h = HEIGHT(TextGravity) };
+	TextGravityRect = GravityRect;
+}
+
+// Alpha is left out, as SDL 1.2 colours have none and every colour drawn here
+// is opaque.
+static bool SameColor(const SDL_Color* A, const SDL_Color* B)
+{
+	return A->r == B->r && A->g == B->g && A->b == B->b;
+}
+
+static void FlushBatch(struct RectBatch* Batch)
+{
+	if (Batch->Count == 0)
+		return;
+	if (Batch->Kind == DRAW_HOLLOW_RECT)
+		RENDER_HOLLOW_RECTS(Batch->Rects, Batch->Count, Batch->Color);
+	else
+		RENDER_FILLED_RECTS(Batch->Rects, Batch->Count, Batch->Color);
+	Batch->Count = 0;
+}
+
+static void AddToBatch(struct RectBatch* Batch, enum DrawKind Kind, const SDL_Color* Color, const SDL_Rect* Rect)
+{
+	if (Batch->Count != 0
+	 && (Batch->Kind != Kind || !SameColor(Batch->Color, Color) || Batch->Count == ELEMENT_COUNT))
+		FlushBatch(Batch);
+	Batch->Kind = Kind;
+	Batch->Color = Color;
+	Batch->Rects[Batch->Count++] = *Rect;
+}
+
+// Draws the display list, merging consecutive rectangles of the same kind
+// and colour into one call. Unless the profile makes elements overlap, the
+// order in which they are drawn does not matter, so all of those in the same
+// colour are merged, whatever their order.
+static void DrawDisplayList(void)
+{
+	struct RectBatch Ordered = { .Count = 0 };
+	struct RectBatch ElementBatches[ELEMENT_COUNT];
+	unsigned int ElementBatchCount = 0;
+	uint16_t Pressed = EventPressedElements();
+	unsigned int i, j;
+
+	for (i = 0; i < DisplayListLength; i++)
 	{
-		DPadOppositeEverPressed = true;
-		SDL_Rect TextCrossErrorRect = { .x = TEXT_CROSS_ERR_LX, .y = TEXT_CROSS_ERR_Y, .w = WIDTH(TextCrossError), .h = HEIGHT(TextCrossError) };
-		RENDER_RASTER(TextCrossError, &TextCrossErrorRect);
+		const struct DrawItem* Item = &DisplayList[i];
+
+		if ((Item->Condition == SHOW_IF_PRESSED && (Pressed & Item->Elements) == 0)
+		 || (Item->Condition == SHOW_IF_DPAD_OPPOSITE && !DPadOppositeEverPressed))
+			continue;
+
+		if (Item->Kind == DRAW_ELEMENT)
+		{
+			const SDL_Color* Color = Input.ElementPressed[Item->Element] ? &ElementColorsPressed[Item->Element] :
+				(Input.ElementEverPressed[Item->Element] ? &ElementColorsEverPressed[Item->Element] : &ColorNeverPressed);
+
+			if (ElementsOverlap)
+			{
+				AddToBatch(&Ordered, DRAW_FILLED_RECT, Color, &Item->Rect);
+				continue;
+			}
+
+			FlushBatch(&Ordered);
+			for (j = 0; j < ElementBatchCount; j++)
+				if (SameColor(ElementBatches[j].Color, Color))
+					break;
+			if (j == ElementBatchCount)
+				ElementBatches[ElementBatchCount++].Count = 0;
+			AddToBatch(&ElementBatches[j], DRAW_FILLED_RECT, Color, &Item->Rect);
+			continue;
+		}
+
+		for (j = 0; j < ElementBatchCount; j++)
+			FlushBatch(&ElementBatches[j]);
+		ElementBatchCount = 0;
+
+		if (Item->Kind == DRAW_RASTER)
+		{
+			FlushBatch(&Ordered);
+			SDL_Rect Rect = Item->Rect;
+			RENDER_RASTER(Item->Raster, &Rect);
+		}
+		else AddToBatch(&Ordered, Item->Kind, Item->Color, &Item->Rect);
 	}
 
-	// Text prompt, if a face button is pressed
-	if (ElementPressed[4] || ElementPressed[5] || ElementPressed[6] || ElementPressed[7])
+	for (j = 0; j < ElementBatchCount; j++)
+		FlushBatch(&ElementBatches[j]);
+	FlushBatch(&Ordered);
+}
+
+/* - - - DISPLAY AND INPUT - - - */
+
+// Translates an SDL event into an event for the input state core. Returns
+// false if the event is not an input event.
+static bool TranslateEvent(const SDL_Event* Event, struct InputEvent* Result)
+{
+	switch (Event->type)
 	{
-		SDL_Rect TextFaceRect = { .x = TEXT_FACE_RX - WIDTH(TextFace), .y = TEXT_FACE_Y, .w = WIDTH(TextFace), .h = HEIGHT(TextFace) };
-		RENDER_RASTER(TextFace, &TextFaceRect);
+		case SDL_JOYAXISMOTION:
+			Result->Type = INPUT_AXIS;
+			Result->Device = JoystickDevice(Event->jaxis.which);
+			Result->Index = Event->jaxis.axis;
+			Result->Value = Event->jaxis.value;
+			return true;
+		case SDL_JOYHATMOTION:
+			Result->Type = INPUT_HAT;
+			Result->Device = JoystickDevice(Event->jhat.which);
+			Result->Index = Event->jhat.hat;
+			Result->Value = Event->jhat.value;
+			return true;
+		case SDL_JOYBUTTONDOWN:
+		case SDL_JOYBUTTONUP:
+			Result->Type = Event->type == SDL_JOYBUTTONDOWN ? INPUT_BUTTON_DOWN : INPUT_BUTTON_UP;
+			Result->Device = JoystickDevice(Event->jbutton.which);
+			Result->Index = Event->jbutton.button;
+			Result->Value = 0;
+			return true;
+		case SDL_KEYDOWN:
+		case SDL_KEYUP:
+			Result->Type = Event->type == SDL_KEYDOWN ? INPUT_KEY_DOWN : INPUT_KEY_UP;
+			Result->Device = DEVICE_NONE;
+			Result->Index = 0;
+#ifdef SDL_1
+			Result->Value = Event->key.keysym.sym;
+#else
+			Result->Value = Event->key.keysym.scancode;
+#endif
+			return true;
+		default:
+			return false;
 	}
+}
 
-	// Text prompt, if another button is pressed
-	if (ElementPressed[8] || ElementPressed[9] || ElementPressed[10] || ElementPressed[11] || ElementPressed[12] || ElementPressed[13])
+// Reports a press for an element that was already pressed, or a release for
+// one that was already released.
+static void ReportRepeatedEvent(const SDL_Event* Event, uint8_t Element)
+{
+	switch (Event->type)
 	{
-		SDL_Rect TextOthersRect = { .x = TEXT_OTHERS_RX - WIDTH(TextOthers), .y = TEXT_OTHERS_Y, .w = WIDTH(TextOthers), .h = HEIGHT(TextOthers) };
-		RENDER_RASTER(TextOthers, &TextOthersRect);
+		case SDL_JOYBUTTONDOWN:
+			printf("Received SDL_JOYBUTTONDOWN for already-pressed button %s (joystick %d button %d)\n", ElementNames[Element], Event->jbutton.which, Event->jbutton.button);
+			break;
+		case SDL_JOYBUTTONUP:
+			printf("Received SDL_JOYBUTTONUP for already-released button %s (joystick %d button %d)\n", ElementNames[Element], Event->jbutton.which, Event->jbutton.button);
+			break;
+		case SDL_KEYDOWN:
+			printf("Received SDL_KEYDOWN for already-pressed button %s (keyboard %s)\n", ElementNames[Element], SDL_GetKeyName(Event->key.keysym.sym));
+			break;
+		case SDL_KEYUP:
+			printf("Received SDL_KEYUP for already-released button %s (keyboard %s)\n", ElementNames[Element], SDL_GetKeyName(Event->key.keysym.sym));
+			break;
 	}
+}
 
-	// Inner border (there to provide a reference frame for the joystick axes'
-	// dots)
-	SDL_Rect InnerRect = { .x = INNER_SCREEN_X, .y = GCW_ZERO_PIC_Y + INNER_SCREEN_Y, .w = INNER_SCREEN_W, .h = INNER_SCREEN_H };
-	RENDER_HOLLOW_RECT(&InnerRect, &ColorInnerBorder);
+static void CreateTextRasters(void)
+{
+	SDL_Surface* Text;
+	Text = TTF_RenderUTF8_Blended(Font, "Directional cross", ColorCross);
+	TextCross = MAKE_STATIC_RASTER(Text);
+	Text = TTF_RenderUTF8_Blended(Font, "Analog nub", ColorAnalog);
+	TextAnalog = MAKE_STATIC_RASTER(Text);
+	Text = TTF_RenderUTF8_Blended(Font, "Gravity sensor", ColorGravity);
+	TextGravity = MAKE_STATIC_RASTER(Text);
+	Text = TTF_RenderUTF8_Blended(Font, "Face buttons", ColorFace);
+	TextFace = MAKE_STATIC_RASTER(Text);
+	Text = TTF_RenderUTF8_Blended(Font, "Other buttons", ColorOthers);
+	TextOthers = MAKE_STATIC_RASTER(Text);
+
+	Text = TTF_RenderUTF8_Blended(Font, "Opposite directions pressed simultaneously on the cross", ColorError);
+	TextCrossError = MAKE_STATIC_RASTER(Text);
+	Text = TTF_RenderUTF8_Blended(Font, "Start+Select to exit", ColorPrompt);
+	TextExit = MAKE_STATIC_RASTER(Text);
+}
+
+static void FreeTextRasters(void)
+{
+	FREE_RASTER(TextCross);
+	FREE_RASTER(TextAnalog);
+	FREE_RASTER(TextGravity);
+	FREE_RASTER(TextFace);
+	FREE_RASTER(TextOthers);
+
+	FREE_RASTER(TextCrossError);
+	FREE_RASTER(TextExit);
+
+	TextCross = TextAnalog = TextGravity = TextFace = TextOthers = NULL;
+	TextCrossError = TextExit = NULL;
+}
+
+static void DrawScreen()
+{
+	// Maintain the status of opposite directions having been pressed at once
+	// on the cross, which a text prompt reports for the rest of the run
+	if ((Input.ElementPressed[ELEMENT_DPAD_UP] && Input.ElementPressed[ELEMENT_DPAD_DOWN])
+	 || (Input.ElementPressed[ELEMENT_DPAD_LEFT] && Input.ElementPressed[ELEMENT_DPAD_RIGHT]))
+		DPadOppositeEverPressed = true;
+
+	DrawDisplayList();
 
 	// A dot to indicate where the analog nub is pointed to, relative to the
 	// inner screen, as well as its coordinates
-	SDL_RASTER_TYPE BuiltInJSCoords = DrawJoystickDot(BuiltInJS_X, BuiltInJS_Y, TEXT_ANALOG_CX, TEXT_ANALOG_Y, TextAnalog, &ColorAnalog);
+	SDL_RASTER_TYPE BuiltInJSCoords = DrawJoystickDot(Input.AxisValues[DEVICE_BUILT_IN][AXIS_X], Input.AxisValues[DEVICE_BUILT_IN][AXIS_Y], &TextAnalogRect, TextAnalog, &ColorAnalog);
 
 	// And another for the gravity sensor
-	SDL_RASTER_TYPE GSensorJSCoords = DrawJoystickDot(GSensorJS_X, GSensorJS_Y, TEXT_GRAVITY_CX, TEXT_GRAVITY_Y, TextGravity, &ColorGravity);
+	SDL_RASTER_TYPE GSensorJSCoords = DrawJoystickDot(Input.AxisValues[DEVICE_G_SENSOR][AXIS_X], Input.AxisValues[DEVICE_G_SENSOR][AXIS_Y], &TextGravityRect, TextGravity, &ColorGravity);
 
-	PRESENT();
+	// In polling mode, outlines for the state last seen by the polling thread
+	if (PollRate != 0)
+	{
+		ReadPollSamples();
+		DrawPollSample();
+	}
+
+#ifdef SDL_1
+	UnlockScreen();
+#endif
+	if (!BenchmarkSkipPresent)
+		PRESENT();
 
 	if (BuiltInJSCoords)
 		FREE_RASTER(BuiltInJSCoords);
 	if (GSensorJSCoords)
 		FREE_RASTER(GSensorJSCoords);
 
-	SDL_Delay(8); // Reduce the delay between this update and the input for the next
+	if (!Benchmark)
+		SDL_Delay(8); // Reduce the delay between this update and the input for the next
 }
 
-int main(int argc, char** argv)
+#ifdef SDL_1
+/* - - - BENCHMARK - - - */
+
+#define BENCHMARK_FILLS    200
+#define BENCHMARK_BLITS   5000
+#define BENCHMARK_FRAMES   300
+
+// Fills Rects Rounds times over, through FillRect16 if Words is true or
+// SDL_FillRect otherwise. Returns the time taken in nanoseconds.
+static uint64_t TimeFills(SDL_Rect* Rects, unsigned int Count, unsigned int Rounds, bool Words)
+{
+	Uint32 MappedColor = SDL_COLOR(ColorBorder);
+	unsigned int i, Round;
+
+	uint64_t Start = ClockNanoseconds(CLOCK_MONOTONIC);
+	for (Round = 0; Round < Rounds; Round++)
+		for (i = 0; i < Count; i++)
+		{
+			if (Words)
+				FillRect16(&Rects[i], MappedColor);
+			else
+				SDL_FillRect(Screen, &Rects[i], MappedColor);
+		}
+	UnlockScreen();
+	return ClockNanoseconds(CLOCK_MONOTONIC) - Start;
+}
+
+// Measures fill and blit throughput and frame time at the given colour depth.
+// The text rasters are recreated in the format of the new screen, as they
+// would be in normal operation.
+static bool RunBenchmark(int BPP)
+{
+	unsigned int i;
+	uint64_t Start, Time;
+
+	FreeTextRasters();
+	if (!SetVideoMode(BPP))
+		return false;
+	CreateTextRasters();
+	LayoutScreen();
+
+	double PixelBytes = Screen->format->BytesPerPixel;
+	printf("%d bpp (%d bytes per pixel):\n", Screen->format->BitsPerPixel, Screen->format->BytesPerPixel);
+
+	// Full-screen fills, alternating between two colours.
+	SDL_Rect ScreenRect = { .x = 0, .y = 0, .w = SCREEN_WIDTH, .h = SCREEN_HEIGHT };
+	Start = ClockNanoseconds(CLOCK_MONOTONIC);
+	for (i = 0; i < BENCHMARK_FILLS; i++)
+		RENDER_FILLED_RECT(&ScreenRect, (i & 1) ? &ColorBorder : &ColorBackground);
+	UnlockScreen();
+	Time = ClockNanoseconds(CLOCK_MONOTONIC) - Start;
+	printf("  Fill: %.3f ms per screen, %.1f MiB/s\n",
+		Time / 1e6 / BENCHMARK_FILLS,
+		PixelBytes * SCREEN_WIDTH * SCREEN_HEIGHT * BENCHMARK_FILLS / (Time / 1e9) / 1048576);
+
+	// At 16 bpp, small fills like those of a frame both ways, so that
+	// FillRect16 has to show that it is worth having.
+	if (UseFillRect16)
+	{
+		SDL_Rect Rects[ELEMENT_COUNT];
+		memcpy(Rects, ElementRects, sizeof(Rects));
+		uint64_t SDLTime = TimeFills(Rects, ELEMENT_COUNT, BENCHMARK_BLITS, false);
+		uint64_t WordTime = TimeFills(Rects, ELEMENT_COUNT, BENCHMARK_BLITS, true);
+		printf("  Element fills: %.3f us per rectangle with SDL_FillRect, %.3f us with FillRect16\n",
+			SDLTime / 1e3 / BENCHMARK_BLITS / ELEMENT_COUNT,
+			WordTime / 1e3 / BENCHMARK_BLITS / ELEMENT_COUNT);
+		SDLTime = TimeFills(&ScreenRect, 1, BENCHMARK_FILLS, false);
+		WordTime = TimeFills(&ScreenRect, 1, BENCHMARK_FILLS, true);
+		printf("  Screen fills: %.3f ms with SDL_FillRect, %.3f ms with FillRect16\n",
+			SDLTime / 1e6 / BENCHMARK_FILLS, WordTime / 1e6 / BENCHMARK_FILLS);
+	}
+
+	// Blits of the widest text prompt.
+	SDL_Rect TextRect = { .x = TEXT_CROSS_ERR_LX, .y = TEXT_CROSS_ERR_Y, .w = WIDTH(TextCrossError), .h = HEIGHT(TextCrossError) };
+	Start = ClockNanoseconds(CLOCK_MONOTONIC);
+	for (i = 0; i < BENCHMARK_BLITS; i++)
+	{
+		SDL_Rect DestRect = TextRect;
+		RENDER_RASTER(TextCrossError, &DestRect);
+	}
+	Time = ClockNanoseconds(CLOCK_MONOTONIC) - Start;
+	printf("  Blit: %.2f us per %dx%d text, %.1f MiB/s written\n",
+		Time / 1e3 / BENCHMARK_BLITS, TextRect.w, TextRect.h,
+		PixelBytes * TextRect.w * TextRect.h * BENCHMARK_BLITS / (Time / 1e9) / 1048576);
+
+	// Whole frames, with everything that can be shown on the screen.
+	BenchmarkSkipPresent = true;
+	Start = ClockNanoseconds(CLOCK_MONOTONIC);
+	for (i = 0; i < BENCHMARK_FRAMES; i++)
+		DrawScreen();
+	Time = ClockNanoseconds(CLOCK_MONOTONIC) - Start;
+	printf("  Frame: %.3f ms drawing", Time / 1e6 / BENCHMARK_FRAMES);
+
+	BenchmarkSkipPresent = false;
+	Start = ClockNanoseconds(CLOCK_MONOTONIC);
+	for (i = 0; i < BENCHMARK_FRAMES; i++)
+		DrawScreen();
+	Time = ClockNanoseconds(CLOCK_MONOTONIC) - Start;
+	printf(", %.3f ms with SDL_Flip\n", Time / 1e6 / BENCHMARK_FRAMES);
+
+	return true;
+}
+
+static void RunBenchmarks(void)
 {
 	unsigned int i;
+
+	for (i = 0; i < ELEMENT_COUNT; i++)
+		Input.ElementPressed[i] = Input.ElementEverPressed[i] = true;
+	Input.AxisValues[DEVICE_BUILT_IN][AXIS_X] = Input.AxisValues[DEVICE_BUILT_IN][AXIS_Y] = -16384;
+	Input.AxisValues[DEVICE_G_SENSOR][AXIS_X] = Input.AxisValues[DEVICE_G_SENSOR][AXIS_Y] = 16384;
+
+	printf("Benchmarking %d fills, %d blits and %d frames per colour depth\n",
+		BENCHMARK_FILLS, BENCHMARK_BLITS, BENCHMARK_FRAMES);
+	if (RunBenchmark(16))
+		RunBenchmark(32);
+}
+#endif
+
+int main(int argc, char** argv)
+{
+	unsigned int i, Device, ProfileCount;
 	bool Error = false;
+	const char* ProfilePath = PROFILE_FILE;
+	bool ProfilePathExplicit = false;
+	const char* RecordPath = NULL;
 
 	printf("SDL " SDL_VER_STR " input tester starting\n");
 
+	for (i = 1; i < (unsigned int) argc; i++)
+	{
+		if (strncmp(argv[i], "--poll=", 7) == 0)
+		{
+			char* End;
+			unsigned long Rate = strtoul(argv[i] + 7, &End, 10);
+			if (*End != '\0' || Rate == 0 || Rate > POLL_RATE_MAX)
+			{
+				printf("Invalid polling rate \"%s\"; must be 1 to %u Hz\n", argv[i] + 7, POLL_RATE_MAX);
+				Error = true;
+				goto end;
+			}
+			PollRate = Rate;
+		}
+		else if (strncmp(argv[i], "--profiles=", 11) == 0)
+		{
+			ProfilePath = argv[i] + 11;
+			ProfilePathExplicit = true;
+		}
+		else if (strncmp(argv[i], "--record=", 9) == 0)
+			RecordPath = argv[i] + 9;
+#ifdef SDL_1
+		else if (strcmp(argv[i], "--bpp=16") == 0)
+			ScreenBPP = 16;
+		else if (strcmp(argv[i], "--bpp=32") == 0)
+			ScreenBPP = 32;
+		else if (strcmp(argv[i], "--benchmark") == 0)
+			Benchmark = true;
+#endif
+		else
+		{
+			printf("Unknown option \"%s\"\n", argv[i]);
+#ifdef SDL_1
+			printf("Usage: %s [--poll=HZ] [--profiles=FILE] [--record=FILE] [--bpp=16|32] [--benchmark]\n", argv[0]);
+#else
+			printf("Usage: %s [--poll=HZ] [--profiles=FILE] [--record=FILE]\n", argv[0]);
+#endif
+			Error = true;
+			goto end;
+		}
+	}
+
+	if (RecordPath != NULL)
+	{
+		// Opened now to fail early; the header is written once the profile
+		// it names has been chosen.
+		RecordFile = fopen(RecordPath, "wb");
+		if (RecordFile == NULL)
+		{
+			printf("Opening %s for recording failed: %s\n", RecordPath, strerror(errno));
+			Error = true;
+			goto end;
+		}
+	}
+
 	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_JOYSTICK) < 0)
 	{
 		printf("SDL initialisation failed: %s\n", SDL_GetError());
@@ -515,6 +1601,35 @@ int main(int argc, char** argv)
 		goto end;
 	}
 
+	// Key names can only be looked up after SDL has been initialised.
+	if (!MakeDefaultProfile(&DefaultProfile))
+	{
+		Error = true;
+		goto cleanup_sdl;
+	}
+	if (!LoadProfiles(ProfilePath, ProfilePathExplicit, &ProfileCount))
+	{
+		Error = true;
+		goto cleanup_sdl;
+	}
+
+	ActiveProfile = SelectProfile(ProfileCount);
+	printf("Using profile \"%s\"\n", ActiveProfile->Name);
+	CompileProfile(ActiveProfile, &Dispatch);
+
+	if (RecordFile != NULL && !WriteInputRecordingHeader(RecordFile,
+#ifdef SDL_1
+		INPUT_KEYS_SDL_1,
+#else
+		INPUT_KEYS_SDL_2,
+#endif
+		ActiveProfile->Name, &Dispatch))
+	{
+		printf("Writing to %s failed: %s\n", RecordPath, strerror(errno));
+		Error = true;
+		goto cleanup_sdl;
+	}
+
 	if (TTF_Init() == -1)
 	{
 		printf("SDL_ttf initialisation failed: %s\n", TTF_GetError());
@@ -534,17 +1649,8 @@ int main(int argc, char** argv)
 	SDL_ShowCursor(SDL_DISABLE);
 
 #ifdef SDL_1
-	Screen = SDL_SetVideoMode(SCREEN_WIDTH, SCREEN_HEIGHT, 32, SDL_HWSURFACE |
-#ifdef SDL_TRIPLEBUF
-		SDL_TRIPLEBUF
-#else
-		SDL_DOUBLEBUF
-#endif
-		);
-
-	if (Screen == NULL)
+	if (!SetVideoMode(ScreenBPP))
 	{
-		printf("SDL_SetVideoMode failed: %s\n", SDL_GetError());
 		Error = true;
 		goto cleanup_font;
 	}
@@ -572,22 +1678,15 @@ int main(int argc, char** argv)
 #endif
 
 	// Pre-render text strings that are always used.
-	SDL_Surface* Text;
-	Text = TTF_RenderUTF8_Blended(Font, "Directional cross", ColorCross);
-	TextCross = MAKE_RASTER(Text);
-	Text = TTF_RenderUTF8_Blended(Font, "Analog nub", ColorAnalog);
-	TextAnalog = MAKE_RASTER(Text);
-	Text = TTF_RenderUTF8_Blended(Font, "Gravity sensor", ColorGravity);
-	TextGravity = MAKE_RASTER(Text);
-	Text = TTF_RenderUTF8_Blended(Font, "Face buttons", ColorFace);
-	TextFace = MAKE_RASTER(Text);
-	Text = TTF_RenderUTF8_Blended(Font, "Other buttons", ColorOthers);
-	TextOthers = MAKE_RASTER(Text);
+	CreateTextRasters();
 
-	Text = TTF_RenderUTF8_Blended(Font, "Opposite directions pressed simultaneously on the cross", ColorError);
-	TextCrossError = MAKE_RASTER(Text);
-	Text = TTF_RenderUTF8_Blended(Font, "Start+Select to exit", ColorPrompt);
-	TextExit = MAKE_RASTER(Text);
+#ifdef SDL_1
+	if (Benchmark)
+	{
+		RunBenchmarks();
+		goto cleanup_rasters;
+	}
+#endif
 
 #ifndef SDL_1
 	if (SDL_InitSubSystem(SDL_INIT_HAPTIC) < 0)
@@ -617,111 +1716,73 @@ int main(int argc, char** argv)
 
 	if (HapticDevice != NULL)
 	{
-		Text = TTF_RenderUTF8_Blended(Font, "L+R to rumble", ColorPrompt);
+		SDL_Surface* Text = TTF_RenderUTF8_Blended(Font, "L+R to rumble", ColorPrompt);
 		TextRumble = MAKE_RASTER(Text);
 	}
 #endif
 
+	LayoutScreen();
+
 #ifdef SDL_1
 	// Make sure we don't get key repeating.
 	SDL_EnableKeyRepeat(0, 0);
 #endif
 	// Initialise joystick input.
 	SDL_JoystickEventState(SDL_ENABLE);
-	SDL_Joystick* BuiltInJS = NULL;
-	SDL_Joystick* GSensorJS = NULL;
+
+	memset(JoystickDevices, DEVICE_NONE, sizeof(JoystickDevices));
 
 	for (i = 0; i < SDL_NumJoysticks(); i++)
 	{
 		printf("Joystick %u: \"%s\"\n", i, JOYSTICK_NAME(i));
 
-		if (strcmp(JOYSTICK_NAME(i), "linkdev device (Analog 2-axis 8-button 2-hat)") == 0)
-			BuiltInJS = SDL_JoystickOpen(i);
-		else if (strcmp(JOYSTICK_NAME(i), "mxc6225") == 0)
-			GSensorJS = SDL_JoystickOpen(i);
+		for (Device = 0; Device < DEVICE_COUNT; Device++)
+		{
+			if (Joysticks[Device] == NULL
+			 && DeviceMatches(ActiveProfile, Device, JOYSTICK_NAME(i)))
+			{
+				Joysticks[Device] = SDL_JoystickOpen(i);
+				if (Joysticks[Device] != NULL
+				 && (unsigned int) JOYSTICK_INDEX(Joysticks[Device]) < JOYSTICK_ID_COUNT)
+					JoystickDevices[JOYSTICK_INDEX(Joysticks[Device])] = Device;
+				break;
+			}
+		}
 	}
 
+	if (PollRate != 0 && !StartPolling())
+		PollRate = 0;
+
 	bool Exit = false;
 	while (!Exit)
 	{
 		SDL_Event Event;
-		while (SDL_PollEvent(&Event) != 0)
+		while (PollEvent(&Event) != 0)
 		{
+			struct InputEvent InputEvent;
+			if (TranslateEvent(&Event, &InputEvent))
+			{
+				if (RecordFile != NULL && !WriteInputEvent(RecordFile, &InputEvent))
+				{
+					printf("Recording failed: %s; recording stops here\n", strerror(errno));
+					fclose(RecordFile);
+					RecordFile = NULL;
+				}
+				enum InputResult Result = ApplyInputEvent(&Input, &Dispatch, &InputEvent);
+				if (Result == INPUT_ALREADY_PRESSED || Result == INPUT_ALREADY_RELEASED)
+					ReportRepeatedEvent(&Event, InputEventElement(&Dispatch, &InputEvent));
+				if (PollRate != 0)
+					RecordEventState(&InputEvent);
+				continue;
+			}
+
 			switch (Event.type)
 			{
-				case SDL_JOYAXISMOTION:
-					if (BuiltInJS != NULL
-					 && Event.jaxis.which == JOYSTICK_INDEX(BuiltInJS))
-					{
-						if (Event.jaxis.axis == 0) /* X */
-							BuiltInJS_X = Event.jaxis.value;
-						else if (Event.jaxis.axis == 1) /* Y */
-							BuiltInJS_Y = Event.jaxis.value;
-					}
-					else if (GSensorJS != NULL
-					      && Event.jaxis.which == JOYSTICK_INDEX(GSensorJS))
-					{
-						if (Event.jaxis.axis == 0) /* X */
-							GSensorJS_X = Event.jaxis.value;
-						else if (Event.jaxis.axis == 1) /* Y */
-							GSensorJS_Y = Event.jaxis.value;
-					}
-					break;
-				case SDL_JOYHATMOTION:
-					if (BuiltInJS != NULL
-					 && Event.jhat.which == JOYSTICK_INDEX(BuiltInJS)
-					 && Event.jhat.hat == 0)
-					{
-						ElementPressed[ELEMENT_DPAD_UP   ] = !!(Event.jhat.value & SDL_HAT_UP);
-						ElementPressed[ELEMENT_DPAD_DOWN ] = !!(Event.jhat.value & SDL_HAT_DOWN);
-						ElementPressed[ELEMENT_DPAD_LEFT ] = !!(Event.jhat.value & SDL_HAT_LEFT);
-						ElementPressed[ELEMENT_DPAD_RIGHT] = !!(Event.jhat.value & SDL_HAT_RIGHT);
-						ElementEverPressed[ELEMENT_DPAD_UP   ] |= ElementPressed[ELEMENT_DPAD_UP];
-						ElementEverPressed[ELEMENT_DPAD_DOWN ] |= ElementPressed[ELEMENT_DPAD_DOWN];
-						ElementEverPressed[ELEMENT_DPAD_LEFT ] |= ElementPressed[ELEMENT_DPAD_LEFT];
-						ElementEverPressed[ELEMENT_DPAD_RIGHT] |= ElementPressed[ELEMENT_DPAD_RIGHT];
-					}
-					break;
-				case SDL_JOYBUTTONDOWN:
-				case SDL_JOYBUTTONUP:
-					if (BuiltInJS != NULL
-					 && Event.jbutton.which == JOYSTICK_INDEX(BuiltInJS))
-					{
-						i = JoyButtonsToElements[Event.jbutton.button];
-						if (ElementPressed[i] && Event.type == SDL_JOYBUTTONDOWN)
-							printf("Received SDL_JOYBUTTONDOWN for already-pressed button %s (joystick %d button %d)\n", ElementNames[i], Event.jbutton.which, Event.jbutton.button);
-						else if (!ElementPressed[i] && Event.type == SDL_JOYBUTTONUP)
-							printf("Received SDL_JOYBUTTONUP for already-released button %s (joystick %d button %d)\n", ElementNames[i], Event.jbutton.which, Event.jbutton.button);
-						ElementPressed[i] = (Event.type == SDL_JOYBUTTONDOWN);
-						ElementEverPressed[i] |= ElementPressed[i];
-					}
-					break;
-				case SDL_KEYDOWN:
-				case SDL_KEYUP:
-					for (i = 0; i < sizeof(KeysHavingElements) / sizeof(KeysHavingElements[0]); i++)
-					{
-#ifdef SDL_1
-						if (Event.key.keysym.sym == KeysHavingElements[i])
-#else
-						if (Event.key.keysym.scancode == KeysHavingElements[i])
-#endif
-						{
-							i = KeysToElements[i];
-							if (ElementPressed[i] && Event.type == SDL_KEYDOWN)
-								printf("Received SDL_KEYDOWN for already-pressed button %s (keyboard %s)\n", ElementNames[i], SDL_GetKeyName(Event.key.keysym.sym));
-							else if (!ElementPressed[i] && Event.type == SDL_KEYUP)
-								printf("Received SDL_KEYUP for already-released button %s (keyboard %s)\n", ElementNames[i], SDL_GetKeyName(Event.key.keysym.sym));
-							ElementPressed[i] = (Event.type == SDL_KEYDOWN);
-							ElementEverPressed[i] = true;
-							break;
-						}
-					}
-					break;
 				case SDL_QUIT:
 					Exit = true;
 					break;
 			} // switch (Event.type)
-		} // while (SDL_PollEvent(&Event))
+		} // while (PollEvent(&Event))
 
 		DrawScreen();
 		Exit |= MustExit();
@@ -735,19 +1796,17 @@ int main(int argc, char** argv)
 		SDL_HapticClose(HapticDevice);
 #endif
 
-	if (BuiltInJS != NULL)
-		SDL_JoystickClose(BuiltInJS);
-	if (GSensorJS != NULL)
-		SDL_JoystickClose(GSensorJS);
+	if (PollRate != 0)
+		StopPolling();
 
-	FREE_RASTER(TextCross);
-	FREE_RASTER(TextAnalog);
-	FREE_RASTER(TextGravity);
-	FREE_RASTER(TextFace);
-	FREE_RASTER(TextOthers);
+	for (Device = 0; Device < DEVICE_COUNT; Device++)
+		if (Joysticks[Device] != NULL)
+			SDL_JoystickClose(Joysticks[Device]);
 
-	FREE_RASTER(TextCrossError);
-	FREE_RASTER(TextExit);
+#ifdef SDL_1
+cleanup_rasters:
+#endif
+	FreeTextRasters();
 
 #ifdef SDL_2
 	SDL_DestroyRenderer(Renderer);
@@ -762,5 +1821,10 @@ cleanup_sdl:
 	SDL_Quit();
 
 end:
+	if (RecordFile != NULL && fclose(RecordFile) != 0)
+	{
+		printf("Recording failed: %s\n", strerror(errno));
+		Error = true;
+	}
 	return Error ? 2 : 0;
 }